@@ -1,5 +1,12 @@
 #include <cassert>
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #define SDL_MAIN_USE_CALLBACKS
 #include <SDL3/SDL.h>
@@ -9,19 +16,246 @@
 
 namespace {
 
-  Triangulation* tri = nullptr;
+  // Mesh exported by the ingest thread, in [0,1] coordinates.
+  struct Frame
+  {
+    std::vector<SDL_FPoint> edges;    // Two endpoints per edge
+    std::vector<uint8_t> boundary;    // One flag per edge
+    std::vector<SDL_FPoint> points;
+    uint64_t generation = 0;
+  };
+
+  // The ingest thread fills back and swaps it with ready, the render thread
+  // swaps ready with front when it holds a newer generation. Neither side
+  // waits for the other to finish with its own buffer.
+  Frame frames[3];
+  Frame* front = &frames[0];
+  Frame* ready = &frames[1];
+  Frame* back = &frames[2];
+  std::mutex frameMutex;
+
+  std::thread ingestThread;
+  std::atomic<bool> run = true;
+  std::atomic<bool> quit = false;
+
+  constexpr size_t QuadsPerBatch = 1 << 16;
+  std::vector<SDL_Vertex> quadVertices;
+  std::vector<int> quadIndices;
+  std::vector<SDL_FRect> rects;
 
   SDL_Window* window = nullptr;
   SDL_Renderer* renderer = nullptr;
+  SDL_Surface* dumpSurface = nullptr;
+
+  const char* dumpPath = nullptr;
+  uint64_t pointBudget = ~uint64_t(0);
+  int width = 1920;
+  int height = 1080;
+
+  Pos randomPos()
+  {
+    Pos p {
+      .x = uint32_t(std::rand()),
+      .y = uint32_t(std::rand())
+    };
+
+    // hash the points to make limited rand() range cover the entire uint32_t-range
+    p.x ^= p.x << 13;
+    p.x ^= p.x >> 17;
+    p.x ^= p.x << 5;
+
+    p.y ^= p.y << 13;
+    p.y ^= p.y >> 17;
+    p.y ^= p.y << 5;
+
+    return p;
+  }
+
+  void exportFrame(const Triangulation& T, Frame& frame)
+  {
+    const float scale = 1.f / 0xffffffff;
+
+    frame.edges.clear();
+    frame.boundary.clear();
+    for (HeIx i = 0; i < T.heCount; i++) {
+      const HalfEdge& he = T.he[i];
+      if (he.twin != NoIx && he.twin < i) {
+        continue;
+      }
+      const Pos& p0 = T.vtx[he.vtx].pos;
+      const Pos& p1 = T.vtx[T.he[he.nxt].vtx].pos;
+      frame.edges.push_back({ scale * p0.x, scale * p0.y });
+      frame.edges.push_back({ scale * p1.x, scale * p1.y });
+      frame.boundary.push_back(he.twin == NoIx);
+    }
+
+    frame.points.clear();
+    for (VtxIx i = 0; i < T.vtxCount; i++) {
+      frame.points.push_back({ scale * T.vtx[i].pos.x, scale * T.vtx[i].pos.y });
+    }
+  }
+
+  // Inserts points in batches that grow with the mesh, so that the O(n)
+  // export after each batch stays a fraction of the insertion work.
+  void ingest()
+  {
+    Triangulation T;
+    uint64_t inserted = 0;
+    uint64_t generation = 0;
+
+    while (!quit && inserted < pointBudget) {
+      if (!run) {
+        SDL_Delay(10);
+        continue;
+      }
+
+      // Pausing and quitting are checked per point, a batch at millions of
+      // points takes far too long to wait for. A cut batch is still shown.
+      uint64_t batch = std::min(pointBudget - inserted, std::max(uint64_t(1), uint64_t(T.vtxCount / 8)));
+      uint64_t i = 0;
+      for (; i < batch && run && !quit; i++) {
+        insertVertex(T, randomPos());
+      }
+      inserted += i;
+      if (quit) break;
+
+      exportFrame(T, *back);
+      back->generation = ++generation;
+      {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        std::swap(back, ready);
+      }
+    }
+  }
+
+  void renderFrame(const Frame& frame, int w, int h)
+  {
+    float s = 0.9f * std::min(w, h);
+    float xo = 0.5f * (w - s);
+    float yo = 0.5f * (h - s) + s;
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+
+    // Edges as one pixel wide quads, submitted in large batches.
+    if (quadIndices.empty()) {
+      for (int i = 0; i < int(QuadsPerBatch); i++) {
+        int indices[6] = { 4 * i + 0, 4 * i + 1, 4 * i + 2, 4 * i + 0, 4 * i + 2, 4 * i + 3 };
+        quadIndices.insert(quadIndices.end(), std::begin(indices), std::end(indices));
+      }
+    }
+    const SDL_FColor interiorColor = { 1.f, 1.f, 1.f, 1.f };
+    const SDL_FColor boundaryColor = { 1.f, 1.f, 0.5f, 1.f };
 
-  Uint64 lastUpdateTicks = 0;
+    size_t edgeCount = frame.boundary.size();
+    for (size_t first = 0; first < edgeCount; first += QuadsPerBatch) {
+      size_t last = std::min(edgeCount, first + QuadsPerBatch);
 
-  bool run = true;
+      quadVertices.clear();
+      for (size_t i = first; i < last; i++) {
+        float x0 = xo + s * frame.edges[2 * i + 0].x;
+        float y0 = yo - s * frame.edges[2 * i + 0].y;
+        float x1 = xo + s * frame.edges[2 * i + 1].x;
+        float y1 = yo - s * frame.edges[2 * i + 1].y;
+
+        float l = std::hypot(x1 - x0, y1 - y0);
+        float nx = l == 0.f ? 0.5f : 0.5f * (y0 - y1) / l;
+        float ny = l == 0.f ? 0.f : 0.5f * (x1 - x0) / l;
+
+        SDL_FColor color = frame.boundary[i] ? boundaryColor : interiorColor;
+        quadVertices.push_back({ .position = { x0 + nx, y0 + ny }, .color = color, .tex_coord = {} });
+        quadVertices.push_back({ .position = { x0 - nx, y0 - ny }, .color = color, .tex_coord = {} });
+        quadVertices.push_back({ .position = { x1 - nx, y1 - ny }, .color = color, .tex_coord = {} });
+        quadVertices.push_back({ .position = { x1 + nx, y1 + ny }, .color = color, .tex_coord = {} });
+      }
+      SDL_RenderGeometry(renderer, nullptr,
+                         quadVertices.data(), int(quadVertices.size()),
+                         quadIndices.data(), int(6 * (last - first)));
+    }
+
+    SDL_SetRenderDrawColorFloat(renderer, 1.f, 0.f, 0.f, 1.f);
+    for (size_t first = 0; first < frame.points.size(); first += QuadsPerBatch) {
+      size_t last = std::min(frame.points.size(), first + QuadsPerBatch);
+
+      rects.clear();
+      for (size_t i = first; i < last; i++) {
+        rects.push_back({
+          .x = xo + s * frame.points[i].x - 2,
+          .y = yo - s * frame.points[i].y - 2,
+          .w = 5,
+          .h = 5
+        });
+      }
+      SDL_RenderRects(renderer, rects.data(), int(rects.size()));
+    }
+  }
+
+  bool parseArgs(int argc, char** argv)
+  {
+    for (int i = 1; i < argc; i++) {
+      if (std::strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+        dumpPath = argv[++i];
+      }
+      else if (std::strcmp(argv[i], "--points") == 0 && i + 1 < argc) {
+        pointBudget = std::strtoull(argv[++i], nullptr, 10);
+      }
+      else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+        if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+          return false;
+        }
+      }
+      else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Builds the mesh on the calling thread, renders it once into a surface
+  // and writes it as a BMP. Needs no video subsystem.
+  SDL_AppResult dumpFrame()
+  {
+    dumpSurface = SDL_CreateSurface(width, height, SDL_PIXELFORMAT_XRGB8888);
+    if (dumpSurface == nullptr) {
+      SDL_Log("Couldn't create surface: %s", SDL_GetError());
+      return SDL_APP_FAILURE;
+    }
+
+    renderer = SDL_CreateSoftwareRenderer(dumpSurface);
+    if (renderer == nullptr) {
+      SDL_Log("Couldn't create renderer: %s", SDL_GetError());
+      return SDL_APP_FAILURE;
+    }
+
+    ingest();
+    std::swap(front, ready);
+    renderFrame(*front, width, height);
+    SDL_RenderPresent(renderer);
+
+    if (!SDL_SaveBMP(dumpSurface, dumpPath)) {
+      SDL_Log("Couldn't save %s: %s", dumpPath, SDL_GetError());
+      return SDL_APP_FAILURE;
+    }
+    return SDL_APP_SUCCESS;
+  }
 
 }
 
 SDL_AppResult SDL_AppInit(void** appstate, int argc, char** argv)
 {
+  if (!parseArgs(argc, argv)) {
+    SDL_Log("Usage: %s [--points N] [--size WxH] [--dump frame.bmp]", argv[0]);
+    return SDL_APP_FAILURE;
+  }
+
+  std::srand(42);
+
+  if (dumpPath) {
+    if (pointBudget == ~uint64_t(0)) {
+      pointBudget = 100000;
+    }
+    return dumpFrame();
+  }
 
   if (!SDL_Init(SDL_INIT_VIDEO)) {
     SDL_Log("Couldn't initialize SDL: %s", SDL_GetError());
@@ -29,22 +263,28 @@ SDL_AppResult SDL_AppInit(void** appstate, int argc, char** argv)
   }
 
 
-  if (!SDL_CreateWindowAndRenderer("Triangles", 1920, 1080, 0, &window, &renderer)) {
+  if (!SDL_CreateWindowAndRenderer("Triangles", width, height, 0, &window, &renderer)) {
     SDL_Log("Couldn't create window/renderer: %s", SDL_GetError());
     return SDL_APP_FAILURE;
   }
 
-  tri = new Triangulation();
-
-  std::srand(42);
+  ingestThread = std::thread(ingest);
   return SDL_APP_CONTINUE;
 }
 
 void SDL_AppQuit(void* appstate, SDL_AppResult result)
 {
-  if (tri) {
-    delete tri;
-    tri = nullptr;
+  quit = true;
+  if (ingestThread.joinable()) {
+    ingestThread.join();
+  }
+  if (renderer) {
+    SDL_DestroyRenderer(renderer);
+    renderer = nullptr;
+  }
+  if (dumpSurface) {
+    SDL_DestroySurface(dumpSurface);
+    dumpSurface = nullptr;
   }
 }
 
@@ -64,77 +304,22 @@ SDL_AppResult SDL_AppEvent(void* appstate, SDL_Event* event)
 
 SDL_AppResult SDL_AppIterate(void* appstate)
 {
-  if (tri == nullptr) {
+  if (renderer == nullptr) {
     return SDL_APP_FAILURE;
   }
 
-  int w = 0;
-  int h = 0;
-  SDL_GetWindowSizeInPixels(window, &w, &h);
-
-  float s = 0.9f * std::min(w, h);
-  float xo = 0.5f * (w - s);
-  float yo = 0.5f * (h - s) + s;
-  float xscale = s / 0xffffffff;
-  float yscale = -s / 0xffffffff;
-
-  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-
-  Uint64 ticks = SDL_GetTicks();
-  if (run && 0 < ticks - lastUpdateTicks) {
-    lastUpdateTicks = ticks;
-
-    Pos p {
-      .x = uint32_t(std::rand()),
-      .y = uint32_t(std::rand())
-    };
-
-    // hash the points to make limited rand() range cover the entire uint32_t-range
-    p.x ^= p.x << 13;
-    p.x ^= p.x >> 17;
-    p.x ^= p.x << 5;
-
-    p.y ^= p.y << 13;
-    p.y ^= p.y >> 17;
-    p.y ^= p.y << 5;
-
-    insertVertex(*tri, p);
-  }
-
-  SDL_RenderClear(renderer);
-  for (size_t i = 0; i < tri->heCount; i++) {
-    const HalfEdge& he = tri->he[i];
-    if (he.twin != NoIx && tri->he[he.twin].vtx < he.vtx) {
-      continue;
-    }
-    const Vertex& v0 = tri->vtx[he.vtx];
-    const Vertex& v1 = tri->vtx[tri->he[he.nxt].vtx];
-
-    if (he.twin == NoIx) {
-      SDL_SetRenderDrawColorFloat(renderer, 1.f, 1.f, 0.5f, 1.f);
+  {
+    std::lock_guard<std::mutex> lock(frameMutex);
+    if (front->generation < ready->generation) {
+      std::swap(front, ready);
     }
-    else {
-      assert(tri->he[he.twin].twin == i);
-      SDL_SetRenderDrawColorFloat(renderer, 1.f, 1.f, 1.f, 1.f);
-    }
-    SDL_RenderLine(renderer,
-                   xo + xscale * v0.pos.x,
-                   yo + yscale * v0.pos.y,
-                   xo + xscale * v1.pos.x,
-                   yo + yscale * v1.pos.y);
   }
 
+  int w = 0;
+  int h = 0;
+  SDL_GetCurrentRenderOutputSize(renderer, &w, &h);
 
-  SDL_SetRenderDrawColorFloat(renderer, 1.f, 0.f, 0.f, 1.f);
-  for (size_t i = 0; i < tri->vtxCount; i++) {
-    SDL_FRect rect{
-      .x = xo + xscale * tri->vtx[i].pos.x - 2,
-      .y = yo + yscale * tri->vtx[i].pos.y - 2,
-      .w = 5,
-      .h = 5
-    };
-    SDL_RenderRect(renderer, &rect);
-  }
+  renderFrame(*front, w, h);
 
   SDL_RenderPresent(renderer);
   return SDL_APP_CONTINUE;
@@ -1,7 +1,15 @@
 #include <algorithm> 
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <cmath>
 #include <cstdlib>
+#include <iterator>
+#include <numbers>
+#include <numeric>
 #include <cstdio>
+#include <queue>
+#include <thread>
 #include <vector>
 #include "delaunay.h"
 
@@ -78,7 +86,7 @@ namespace {
 
     for (size_t j = 0; j < N; j++) {
       uint64_t k = 0;
-      for (size_t i = 0; i < 2; i++) {
+      for (size_t i = 0; i < N; i++) {
         uint64_t hi;
         uint64_t lo = _umul128(x.word[j], y.word[i], &hi);
         uint8_t c0 = _addcarry_u64(0, lo, r.word[j + i], &lo);
@@ -105,6 +113,69 @@ namespace {
     return r;
   }
 
+  template<size_t N>
+  Int<N> sext(int64_t x)
+  {
+    Int<N> r{};
+    r.word[0] = uint64_t(x);
+    for (size_t i = 1; i < N; i++) {
+      r.word[i] = x < 0 ? Int<N>::Ones : Int<N>::Zeros;
+    }
+    return r;
+  }
+
+  template<size_t M, size_t N>
+  Int<M> widen(const Int<N>& x)
+  {
+    static_assert(N <= M);
+    Int<M> r{};
+    for (size_t i = 0; i < M; i++) {
+      r.word[i] = i < N ? x.word[i] : (int64_t(x.word[N - 1]) < 0 ? Int<M>::Ones : Int<M>::Zeros);
+    }
+    return r;
+  }
+
+  template<size_t M, size_t N>
+  Int<M> trunc(const Int<N>& x)
+  {
+    static_assert(M <= N);
+    Int<M> r{};
+    for (size_t i = 0; i < M; i++) {
+      r.word[i] = x.word[i];
+    }
+    return r;
+  }
+
+  template<size_t N>
+  int sign(const Int<N>& x)
+  {
+    if (int64_t(x.word[N - 1]) < 0) return -1;
+    for (size_t i = 0; i < N; i++) {
+      if (x.word[i]) return 1;
+    }
+    return 0;
+  }
+
+  // Unsigned comparison.
+  template<size_t N>
+  bool less(const Int<N>& x, const Int<N>& y)
+  {
+    for (size_t i = N; 0 < i; i--) {
+      if (x.word[i - 1] != y.word[i - 1]) return x.word[i - 1] < y.word[i - 1];
+    }
+    return false;
+  }
+
+  template<size_t N>
+  double toDouble(const Int<N>& x)
+  {
+    double r = 0.0;
+    for (size_t i = N; 0 < i; i--) {
+      r = r * 18446744073709551616.0 + double(x.word[i - 1]);
+    }
+    return r;
+  }
+
   // -------------------------------------------------------------------------
   //
   // Geometric predicates
@@ -289,6 +360,47 @@ namespace {
     return 0;
   }
 
+  // Positive if p4 lies strictly inside the circumcircle of the
+  // counter-clockwise triangle (p1, p2, p3), negative if outside and zero if
+  // on the circle.
+  int inCircle(const Pos& p1, const Pos& p2, const Pos& p3, const Pos& p4)
+  {
+    Int<2> ax = sext<2>(int64_t(p1.x) - int64_t(p4.x));  // 33 bits signed
+    Int<2> ay = sext<2>(int64_t(p1.y) - int64_t(p4.y));
+    Int<2> bx = sext<2>(int64_t(p2.x) - int64_t(p4.x));
+    Int<2> by = sext<2>(int64_t(p2.y) - int64_t(p4.y));
+    Int<2> cx = sext<2>(int64_t(p3.x) - int64_t(p4.x));
+    Int<2> cy = sext<2>(int64_t(p3.y) - int64_t(p4.y));
+
+    Int<2> bc = sub(trunc<2>(muls(bx, cy)), trunc<2>(muls(cx, by)));  // 67 bits
+    Int<2> ca = sub(trunc<2>(muls(cx, ay)), trunc<2>(muls(ax, cy)));
+    Int<2> ab = sub(trunc<2>(muls(ax, by)), trunc<2>(muls(bx, ay)));
+
+    Int<2> la = add(trunc<2>(muls(ax, ax)), trunc<2>(muls(ay, ay)));  // 67 bits
+    Int<2> lb = add(trunc<2>(muls(bx, bx)), trunc<2>(muls(by, by)));
+    Int<2> lc = add(trunc<2>(muls(cx, cx)), trunc<2>(muls(cy, cy)));
+
+    Int<4> test = add(add(muls(la, bc), muls(lb, ca)), muls(lc, ab));  // 136 bits
+    return sign(test);
+  }
+
+  Int<2> lengthSq(const Pos& a, const Pos& b)
+  {
+    Int<2> dx = sext<2>(int64_t(b.x) - int64_t(a.x));
+    Int<2> dy = sext<2>(int64_t(b.y) - int64_t(a.y));
+    return add(trunc<2>(muls(dx, dx)), trunc<2>(muls(dy, dy)));  // 65 bits
+  }
+
+  // True if c lies strictly inside the circle with diameter a b.
+  bool encroaches(const Pos& a, const Pos& b, const Pos& c)
+  {
+    Int<2> ax = sext<2>(int64_t(a.x) - int64_t(c.x));
+    Int<2> ay = sext<2>(int64_t(a.y) - int64_t(c.y));
+    Int<2> bx = sext<2>(int64_t(b.x) - int64_t(c.x));
+    Int<2> by = sext<2>(int64_t(b.y) - int64_t(c.y));
+    return sign(add(trunc<2>(muls(ax, bx)), trunc<2>(muls(ay, by)))) < 0;
+  }
+
   // -------------------------------------------------------------------------
   //
   // Half-edge data structure management
@@ -311,6 +423,14 @@ namespace {
     return T.he[he].twin;
   }
 
+  // Smallest half-edge index of the triangle, identifies the triangle.
+  HeIx triangleKey(const Triangulation& T, HeIx he)
+  {
+    HeIx he1 = next(T, he);
+    HeIx he2 = next(T, he1);
+    return std::min(he, std::min(he1, he2));
+  }
+
   uint32_t allocSize(uint32_t minimum, uint32_t allocated)
   {
     uint64_t grow = std::max(std::max(minimum, 1024u), (allocated + 1) / 2);
@@ -319,6 +439,41 @@ namespace {
     return size;
   }
 
+  // Flags the chunks holding [first, first + count) as written since the
+  // last published snapshot.
+  void markDirty(std::vector<uint8_t>& dirty, uint32_t first, uint32_t count)
+  {
+    uint32_t end = ((first + count - 1) >> ChunkShift) + 1;
+    if (dirty.size() < end) dirty.resize(end, 1);
+    for (uint32_t c = first >> ChunkShift; c < end; c++) {
+      dirty[c] = 1;
+    }
+  }
+
+  bool isConstrained(const Triangulation& T, HeIx he)
+  {
+    size_t w = he >> 6;
+    return w < T.constrained.size() && ((T.constrained[w] >> (he & 63)) & 1);
+  }
+
+  void setConstrained(Triangulation& T, HeIx he, bool value)
+  {
+    size_t w = he >> 6;
+    if (T.constrained.size() <= w) {
+      if (!value) return;
+      T.constrained.resize((size_t(T.heAlloc) + 63) >> 6);
+    }
+    uint64_t bit = uint64_t(1) << (he & 63);
+    T.constrained[w] = value ? (T.constrained[w] | bit) : (T.constrained[w] & ~bit);
+  }
+
+  HalfEdge& writeHe(Triangulation& T, HeIx he)
+  {
+    assert(he != NoIx);
+    T.heDirty[he >> ChunkShift] = 1;
+    return T.he[he];
+  }
+
   VtxIx allocVtx(Triangulation& triang, uint32_t count = 1)
   {
     uint32_t newCount = triang.vtxCount + count;
@@ -330,6 +485,7 @@ namespace {
     }
     VtxIx firstIx = triang.vtxCount;
     triang.vtxCount += count;
+    markDirty(triang.vtxDirty, firstIx, count);
     return firstIx;
   }
 
@@ -344,6 +500,7 @@ namespace {
     }
     HeIx firstIx = triang.heCount;
     triang.heCount += count;
+    markDirty(triang.heDirty, firstIx, count);
 
     for (size_t i = firstIx; i < triang.heCount; i++) {
       triang.he[i].vtx = NoIx;
@@ -356,9 +513,9 @@ namespace {
 
   void disconnectHalfEdge(Triangulation& triang, HeIx he)
   {
-    HalfEdge& e = triang.he[he];
+    HalfEdge& e = writeHe(triang, he);
     if (e.twin != NoIx) {
-      triang.he[e.twin].twin = NoIx;
+      writeHe(triang, e.twin).twin = NoIx;
       e.twin = NoIx;
     }
     e.vtx = NoIx;
@@ -368,7 +525,7 @@ namespace {
   void connectHalfEdge(Triangulation& triang, HeIx curr, HeIx next, HeIx twin, VtxIx vtx)
   {
     assert(curr != NoIx && next != NoIx && vtx != NoIx) ;
-    HalfEdge& e = triang.he[curr];
+    HalfEdge& e = writeHe(triang, curr);
     assert(e.vtx == NoIx);
     assert(e.nxt == NoIx);
     assert(e.twin == NoIx);
@@ -377,7 +534,7 @@ namespace {
     if (twin != NoIx) {
       e.twin = twin;
       assert(triang.he[twin].twin == NoIx);
-      triang.he[twin].twin = curr;
+      writeHe(triang, twin).twin = curr;
     }
   }
 
@@ -410,21 +567,41 @@ namespace {
   //
   // Operations on top of the half-edge data structure
 
-  HeIx findContainingTriangle(const Triangulation& triang, bool (&inside)[3], const Pos& pos, HeIx startingPoint)
+  const HalfEdge& halfEdgeAt(const Triangulation& T, HeIx he) { return T.he[he]; }
+  const HalfEdge& halfEdgeAt(const TriangulationSnapshot& S, HeIx he) { return S.he(he); }
+  const Vertex& vertexAt(const Triangulation& T, VtxIx v) { return T.vtx[v]; }
+  const Vertex& vertexAt(const TriangulationSnapshot& S, VtxIx v) { return S.vtx(v); }
+
+  // Visibility walk from the triangle of startingPoint towards pos. The walk
+  // ends with NoIx if it would cross the edge of a half-edge for which stop
+  // returns true, with that half-edge in blocked.
+  template<typename Mesh, typename Stop>
+  HeIx visibilityWalk(const Mesh& triang, bool (&inside)[3], const Pos& pos, HeIx startingPoint, Stop stop, HeIx& blocked)
   {
     HeIx he = startingPoint;
+    uint32_t rnd = startingPoint;
 
     restart:
       for (size_t i = 0; i < 3; i++) {
-        HalfEdge& c = triang.he[he];
-        HalfEdge& n = triang.he[c.nxt];
-        Vertex& a = triang.vtx[c.vtx];
-        Vertex& b = triang.vtx[n.vtx];
+        const HalfEdge& c = halfEdgeAt(triang, he);
+        const HalfEdge& n = halfEdgeAt(triang, c.nxt);
+        const Vertex& a = vertexAt(triang, c.vtx);
+        const Vertex& b = vertexAt(triang, n.vtx);
 
         int sign = areaSign(a.pos, b.pos, pos);
         if (sign < 0) {
+          if (stop(he)) {
+            blocked = he;
+            return NoIx;
+          }
           assert(c.twin != NoIx); // Going outside of triangulation.
           he = c.twin;
+
+          // Randomize which edge is tested first, a deterministic visibility
+          // walk may cycle in constrained triangulations.
+          rnd = rnd * 1664525u + 1013904223u;
+          he = halfEdgeAt(triang, he).nxt;
+          if (rnd & 0x80000000u) he = halfEdgeAt(triang, he).nxt;
           goto restart;
         }
         inside[i] = 0 < sign;
@@ -433,6 +610,107 @@ namespace {
       return he;
   }
 
+  template<typename Mesh>
+  HeIx findContainingTriangle(const Mesh& triang, bool (&inside)[3], const Pos& pos, HeIx startingPoint)
+  {
+    HeIx blocked = NoIx;
+    return visibilityWalk(triang, inside, pos, startingPoint, [](HeIx) { return false; }, blocked);
+  }
+
+  // Collects one half-edge per triangle of the Bowyer-Watson cavity of pos,
+  // grown from the triangle of he with exact in-circle tests, without
+  // modifying the triangulation. Edges for which stop returns true are not
+  // crossed.
+  template<typename Stop>
+  void bowyerWatsonCavity(const Triangulation& T, std::vector<HeIx>& cavity, std::vector<HeIx>& todo, HeIx he, const Pos& pos, Stop stop)
+  {
+    cavity.clear();
+    todo.clear();
+    cavity.push_back(triangleKey(T, he));
+    todo.push_back(he);
+    while (!todo.empty()) {
+      HeIx t = todo.back();
+      todo.pop_back();
+
+      for (size_t k = 0; k < 3; k++, t = next(T, t)) {
+        HeIx tw = twin(T, t);
+        if (tw == NoIx || stop(t)) continue;
+
+        HeIx key = triangleKey(T, tw);
+        if (std::find(cavity.begin(), cavity.end(), key) != cavity.end()) continue;
+
+        HeIx tw1 = next(T, tw);
+        HeIx tw2 = next(T, tw1);
+        if (0 < inCircle(T.vtx[vertex(T, tw)].pos, T.vtx[vertex(T, tw1)].pos, T.vtx[vertex(T, tw2)].pos, pos)) {
+          cavity.push_back(key);
+          todo.push_back(tw);
+        }
+      }
+    }
+  }
+
+  // Triangles are journaled rotated to start at their smallest vertex index
+  // and edges with the smallest index first, so that an entry destroyed and
+  // created within the same batch compares equal and cancels on drain.
+  void journalTriangle(std::vector<Triangle>& log, VtxIx a, VtxIx b, VtxIx c)
+  {
+    if (b < a && b < c) log.push_back({ .vtx = { b, c, a } });
+    else if (c < a && c < b) log.push_back({ .vtx = { c, a, b } });
+    else log.push_back({ .vtx = { a, b, c } });
+  }
+
+  void journalEdge(std::vector<Edge>& log, VtxIx a, VtxIx b)
+  {
+    log.push_back({ .vtx = { std::min(a, b), std::max(a, b) } });
+  }
+
+  // Replaces the diagonal he of the quadrilateral formed by the two triangles
+  // sharing it with the other diagonal. The half-edge pair he and twin(he)
+  // becomes the new diagonal, the four outer half-edges keep their edges.
+  void flipEdge(Triangulation& T, HeIx he)
+  {
+    HeIx tw = twin(T, he);
+    assert(tw != NoIx);
+    assert(!isConstrained(T, he));
+
+    HeIx l0 = next(T, he);
+    HeIx l1 = next(T, l0);
+    HeIx l2 = next(T, tw);
+    HeIx l3 = next(T, l2);
+
+    VtxIx v0 = vertex(T, l0);
+    VtxIx v1 = vertex(T, l1);
+    VtxIx v2 = vertex(T, l2);
+    VtxIx v3 = vertex(T, l3);
+
+    HeIx t0 = twin(T, l0);
+    HeIx t1 = twin(T, l1);
+    HeIx t2 = twin(T, l2);
+    HeIx t3 = twin(T, l3);
+
+    if (T.journaling) {
+      journalTriangle(T.journal.destroyedTriangles, v2, v0, v1);
+      journalTriangle(T.journal.destroyedTriangles, v0, v2, v3);
+      journalTriangle(T.journal.createdTriangles, v0, v1, v3);
+      journalTriangle(T.journal.createdTriangles, v2, v3, v1);
+      journalEdge(T.journal.destroyedEdges, v0, v2);
+      journalEdge(T.journal.createdEdges, v1, v3);
+    }
+
+    disconnectTriangle(T, he);
+    disconnectTriangle(T, tw);
+
+    connectTriangle(T,
+                    l0, t0, v0,
+                    he, NoIx, v1,
+                    l3, t3, v3);
+
+    connectTriangle(T,
+                    l2, t2, v2,
+                    tw, he, v3,
+                    l1, t1, v1);
+  }
+
   void recursiveDelaunaySwap(Triangulation& T, std::vector<HeIx>& todo)
   {
     while (!todo.empty()) {
@@ -443,18 +721,18 @@ namespace {
       HeIx tw = twin(T, he);
       if (tw == NoIx) continue;
 
+      if (isConstrained(T, he)) continue;
 
       HeIx l0 = next(T, he);
       HeIx l1 = next(T, l0);
       HeIx l2 = next(T, tw);
       HeIx l3 = next(T, l2);
 
-      
       VtxIx v0 = vertex(T, l0);
       VtxIx v1 = vertex(T, l1);
       VtxIx v2 = vertex(T, l2);
       VtxIx v3 = vertex(T, l3);
-      
+
       int del = isDelaunay(T.vtx[v0].pos, T.vtx[v1].pos, T.vtx[v2].pos, T.vtx[v3].pos);
       if (0 <= del) continue;
 
@@ -463,18 +741,7 @@ namespace {
       HeIx t2 = twin(T, l2);
       HeIx t3 = twin(T, l3);
 
-      disconnectTriangle(T, he);
-      disconnectTriangle(T, tw);
-
-      connectTriangle(T,
-                      l0, t0, v0,
-                      he, NoIx, v1,
-                      l3, t3, v3);
-
-      connectTriangle(T,
-                      l2, t2, v2,
-                      tw, he, v3,
-                      l1, t1, v1);
+      flipEdge(T, he);
 
       todo.push_back(t0);
       todo.push_back(t1);
@@ -515,21 +782,45 @@ namespace {
     VtxIx v2 = vertex(T, a1);
     VtxIx v3 = vertex(T, a2);
 
+    // Both halves of a split constrained edge stay constrained, and outer
+    // edges keep their flag when moved to a new half-edge.
+    bool k0 = isConstrained(T, a0);
+    bool k2 = isConstrained(T, a1);
+    bool k3 = isConstrained(T, a2);
+
+    if (T.journaling) {
+      journalTriangle(T.journal.destroyedTriangles, v0, v2, v3);
+      journalTriangle(T.journal.createdTriangles, mid, v2, v3);
+      journalTriangle(T.journal.createdTriangles, v0, mid, v3);
+      journalEdge(T.journal.destroyedEdges, v0, v2);
+      journalEdge(T.journal.createdEdges, v0, mid);
+      journalEdge(T.journal.createdEdges, mid, v2);
+      journalEdge(T.journal.createdEdges, mid, v3);
+    }
+
     HeIx b0 = allocHe(T, onBoundary ? 3 : 6);
     HeIx b1 = b0 + 1;
     HeIx b2 = b0 + 2;
 
     HeIx d0 = onBoundary ? NoIx : (b0 + 3);
 
-    T.he[a0] = { .vtx = mid, .nxt = a1, .twin = d0 };
-    T.he[a1] = { .vtx = v2,  .nxt = a2, .twin = n2 };
-    T.he[a2] = { .vtx = v3,  .nxt = a0, .twin = b1 };
-    if (n2 != NoIx) T.he[n2].twin = a1;
-
-    T.he[b0] = { .vtx = v0,  .nxt = b1, .twin = c0 };
-    T.he[b1] = { .vtx = mid, .nxt = b2, .twin = a2 };
-    T.he[b2] = { .vtx = v3,  .nxt = b0, .twin = n3 };
-    if (n3 != NoIx) T.he[n3].twin = b2;
+    writeHe(T, a0) = { .vtx = mid, .nxt = a1, .twin = d0 };
+    writeHe(T, a1) = { .vtx = v2,  .nxt = a2, .twin = n2 };
+    writeHe(T, a2) = { .vtx = v3,  .nxt = a0, .twin = b1 };
+    if (n2 != NoIx) writeHe(T, n2).twin = a1;
+
+    writeHe(T, b0) = { .vtx = v0,  .nxt = b1, .twin = c0 };
+    writeHe(T, b1) = { .vtx = mid, .nxt = b2, .twin = a2 };
+    writeHe(T, b2) = { .vtx = v3,  .nxt = b0, .twin = n3 };
+    if (n3 != NoIx) writeHe(T, n3).twin = b2;
+
+    if (!T.constrained.empty()) {
+      setConstrained(T, a0, k0);
+      setConstrained(T, a1, k2);
+      setConstrained(T, a2, false);
+      setConstrained(T, b0, k0);
+      setConstrained(T, b2, k3);
+    }
 
     if (onBoundary) {
       std::vector<HeIx> todo = { a1, a2, b2 };
@@ -546,15 +837,33 @@ namespace {
 
       VtxIx v1 = vertex(T, c2);
 
-      T.he[c0] = { .vtx = mid, .nxt = c1, .twin = b0 };
-      T.he[c1] = { .vtx = v0,  .nxt = c2, .twin = n0 };
-      T.he[c2] = { .vtx = v1,  .nxt = c0, .twin = d1 };
-      if(n0 != NoIx) T.he[n0].twin = c1;
+      bool k1 = isConstrained(T, c1);
+      bool k4 = isConstrained(T, c2);
 
-      T.he[d0] = { .vtx = v2,  .nxt = d1, .twin = a0 };
-      T.he[d1] = { .vtx = mid, .nxt = d2, .twin = c2 };
-      T.he[d2] = { .vtx = v1,  .nxt = d0, .twin = n1 };
-      if (n1 != NoIx) T.he[n1].twin = d2;
+      if (T.journaling) {
+        journalTriangle(T.journal.destroyedTriangles, v2, v0, v1);
+        journalTriangle(T.journal.createdTriangles, mid, v0, v1);
+        journalTriangle(T.journal.createdTriangles, v2, mid, v1);
+        journalEdge(T.journal.createdEdges, mid, v1);
+      }
+
+      writeHe(T, c0) = { .vtx = mid, .nxt = c1, .twin = b0 };
+      writeHe(T, c1) = { .vtx = v0,  .nxt = c2, .twin = n0 };
+      writeHe(T, c2) = { .vtx = v1,  .nxt = c0, .twin = d1 };
+      if(n0 != NoIx) writeHe(T, n0).twin = c1;
+
+      writeHe(T, d0) = { .vtx = v2,  .nxt = d1, .twin = a0 };
+      writeHe(T, d1) = { .vtx = mid, .nxt = d2, .twin = c2 };
+      writeHe(T, d2) = { .vtx = v1,  .nxt = d0, .twin = n1 };
+      if (n1 != NoIx) writeHe(T, n1).twin = d2;
+
+      if (!T.constrained.empty()) {
+        setConstrained(T, c0, k0);
+        setConstrained(T, c1, k1);
+        setConstrained(T, c2, false);
+        setConstrained(T, d0, k0);
+        setConstrained(T, d2, k4);
+      }
 
       std::vector<HeIx> todo = { a0, a1, a2, b0, b2, c1, c2, d2 };
       recursiveDelaunaySwap(T, todo);
@@ -574,8 +883,26 @@ namespace {
     HeIx tw1 = T.he[he1].twin;
     HeIx tw2 = T.he[he2].twin;
 
+    if (T.journaling) {
+      journalTriangle(T.journal.destroyedTriangles, v0, v1, v2);
+      journalTriangle(T.journal.createdTriangles, v0, v1, mid);
+      journalTriangle(T.journal.createdTriangles, v1, v2, mid);
+      journalTriangle(T.journal.createdTriangles, v2, v0, mid);
+      journalEdge(T.journal.createdEdges, v0, mid);
+      journalEdge(T.journal.createdEdges, v1, mid);
+      journalEdge(T.journal.createdEdges, v2, mid);
+    }
+
     HeIx he3 = allocHe(T, 6);
 
+    // he1 and he2 become interior edges, their outer edges move to he3+0 and he3+3.
+    if (!T.constrained.empty()) {
+      setConstrained(T, he3 + 0, isConstrained(T, he1));
+      setConstrained(T, he3 + 3, isConstrained(T, he2));
+      setConstrained(T, he1, false);
+      setConstrained(T, he2, false);
+    }
+
     disconnectTriangle(T, he0);
     connectTriangle(T,
                     he0, tw0, v0,
@@ -594,6 +921,217 @@ namespace {
     recursiveDelaunaySwap(T, todo);
   }
 
+  VtxIx insertVertexFrom(Triangulation& T, const Pos& pos, HeIx startingPoint)
+  {
+    bool inside[3] = {};
+
+    HeIx he = findContainingTriangle(T, inside, pos, startingPoint);
+    if (he == NoIx) return NoIx;
+
+    size_t insideCase = (inside[0] ? 1 : 0) + (inside[1] ? 2 : 0) + (inside[2] ? 4 : 0);
+    switch (insideCase) {
+
+    // Point on three edges boundary => degenerate triangle.
+    case 0b000:
+      assert(false && "Hit degenerate triangle");
+      return NoIx;
+
+    // Point on two edges => lies on a corner
+    case 0b001: he = next(T, he); [[fallthrough]];
+    case 0b100: he = next(T, he); [[fallthrough]];
+    case 0b010: {
+      VtxIx v = vertex(T, he);
+      assert(T.vtx[v].pos.x == pos.x && T.vtx[v].pos.y == pos.y);
+      return v;
+    }
+
+    // Point on one edge => lies in the interior of an edge
+    case 0b011: he = next(T, he); [[fallthrough]];
+    case 0b101: he = next(T, he); [[fallthrough]];
+    case 0b110: {
+      const Pos& a = T.vtx[vertex(T, he)].pos;
+      const Pos& b = T.vtx[vertex(T, next(T, he))].pos;
+      assert(areaSign(a, b, pos) == 0);
+
+      VtxIx v = allocVtx(T);
+      T.vtx[v].pos = pos;
+      splitEdge(T, he, v);
+      return v;
+    }
+
+    // Point in the interior of the triangle
+    case 0b111: {
+      VtxIx v = allocVtx(T);
+      T.vtx[v].pos = pos;
+      splitTriangle(T, he, v);
+      return v;
+    }
+
+    default:
+      assert(false);
+      return NoIx;
+    }
+  }
+
+  // Collects one outgoing half-edge of the origin of he per incident
+  // triangle, in counter-clockwise order.
+  void vertexStar(const Triangulation& T, std::vector<HeIx>& star, HeIx he)
+  {
+    HeIx first = he;
+    while (twin(T, he) != NoIx) {
+      he = next(T, twin(T, he));
+      if (he == first) break;
+    }
+
+    first = he;
+    do {
+      star.push_back(he);
+      he = twin(T, next(T, next(T, he)));
+    } while (he != NoIx && he != first);
+  }
+
+  // -------------------------------------------------------------------------
+  //
+  // Constrained edges
+
+  HeIx vertexHalfEdge(const Triangulation& T, VtxIx v, HeIx startingPoint)
+  {
+    bool inside[3] = {};
+    HeIx he = findContainingTriangle(T, inside, T.vtx[v].pos, startingPoint);
+    for (size_t i = 0; i < 3; i++, he = next(T, he)) {
+      if (vertex(T, he) == v) return he;
+    }
+    assert(false && "Vertex not in triangulation");
+    return NoIx;
+  }
+
+  // Given x collinear with a and b, true if x lies on the ray from a through b.
+  bool alongRay(const Pos& a, const Pos& b, const Pos& x)
+  {
+    if (a.x != b.x) return (a.x < b.x) == (a.x < x.x);
+    return (a.y < b.y) == (a.y < x.y);
+  }
+
+  bool segmentsCross(const Pos& a, const Pos& b, const Pos& c, const Pos& d)
+  {
+    return areaSign(a, b, c) * areaSign(a, b, d) < 0 && areaSign(c, d, a) * areaSign(c, d, b) < 0;
+  }
+
+  // Walks from the origin of he towards b, collecting the half-edges properly
+  // crossed by the segment until it reaches either b or a vertex lying on
+  // the segment, which is returned. On return, he is the existing edge
+  // between a and that vertex, in either direction, if nothing was crossed,
+  // otherwise an outgoing half-edge of it.
+  VtxIx walkSegment(const Triangulation& T, std::vector<HeIx>& crossed, HeIx& he, VtxIx b)
+  {
+    VtxIx a = vertex(T, he);
+    const Pos& pa = T.vtx[a].pos;
+    const Pos& pb = T.vtx[b].pos;
+
+    // Rewind clockwise to the boundary, if any, so that a counter-clockwise
+    // sweep visits every triangle around a.
+    HeIx first = he;
+    while (twin(T, he) != NoIx) {
+      he = next(T, twin(T, he));
+      if (he == first) break;
+    }
+
+    first = he;
+    while (true) {
+      VtxIx x = vertex(T, next(T, he));
+      VtxIx y = vertex(T, next(T, next(T, he)));
+      if (x == b) return b;
+
+      int sx = areaSign(pa, T.vtx[x].pos, pb);
+      if (sx == 0 && alongRay(pa, pb, T.vtx[x].pos)) return x;
+      int sy = areaSign(pa, T.vtx[y].pos, pb);
+      if (0 < sx && sy < 0) break;
+
+      // At the end of an open fan, y is not the x of any triangle, and the
+      // segment may run along the hull edge y -> a.
+      HeIx back = next(T, next(T, he));
+      if (twin(T, back) == NoIx && (y == b || (sy == 0 && alongRay(pa, pb, T.vtx[y].pos)))) {
+        he = back;
+        return y;
+      }
+
+      he = twin(T, back);
+      assert(he != NoIx && he != first && "Segment leaves triangulation");
+    }
+
+    // Edge e goes from the right to the left side of a -> b.
+    HeIx e = next(T, he);
+    while (true) {
+      crossed.push_back(e);
+      HeIx tw = twin(T, e);
+      assert(tw != NoIx);
+
+      he = next(T, next(T, tw));
+      VtxIx z = vertex(T, he);
+      if (z == b) return b;
+
+      int s = areaSign(pa, pb, T.vtx[z].pos);
+      if (s == 0) return z;
+      e = 0 < s ? next(T, tw) : he;
+    }
+  }
+
+  // Sloan's method: flip crossed edges whose quadrilateral is strictly convex
+  // until no edge crosses a -> c. Such an edge exists in every round, so this
+  // terminates. Flipped edges no longer crossing go to created.
+  void flipOutCrossings(Triangulation& T, std::vector<HeIx>& crossed, std::vector<HeIx>& created, VtxIx a, VtxIx c)
+  {
+    const Pos& pa = T.vtx[a].pos;
+    const Pos& pc = T.vtx[c].pos;
+
+    std::vector<HeIx> remaining;
+    while (!crossed.empty()) {
+      remaining.clear();
+      for (HeIx e : crossed) {
+        VtxIx v0 = vertex(T, next(T, e));
+        VtxIx v1 = vertex(T, next(T, next(T, e)));
+        VtxIx v2 = vertex(T, e);
+        VtxIx v3 = vertex(T, next(T, next(T, twin(T, e))));
+        const Pos& p0 = T.vtx[v0].pos;
+        const Pos& p1 = T.vtx[v1].pos;
+        const Pos& p2 = T.vtx[v2].pos;
+        const Pos& p3 = T.vtx[v3].pos;
+
+        if (areaSign(p0, p1, p3) <= 0 || areaSign(p2, p3, p1) <= 0) {
+          remaining.push_back(e);
+          continue;
+        }
+
+        flipEdge(T, e);
+        if (segmentsCross(pa, pc, p1, p3)) remaining.push_back(e);
+        else created.push_back(e);
+      }
+      std::swap(crossed, remaining);
+    }
+  }
+
+  void markConstrained(Triangulation& T, HeIx he)
+  {
+    setConstrained(T, he, true);
+    HeIx tw = twin(T, he);
+    if (tw != NoIx) setConstrained(T, tw, true);
+  }
+
+  //
+  // Bounding corners
+
+  // The constructor creates the four corners of the bounding box first.
+  bool isBoundingCorner(VtxIx v)
+  {
+    return v < 4;
+  }
+
+  bool touchesBoundingCorner(const Triangulation& T, HeIx he)
+  {
+    HeIx he1 = next(T, he);
+    return isBoundingCorner(vertex(T, he)) || isBoundingCorner(vertex(T, he1)) || isBoundingCorner(vertex(T, next(T, he1)));
+  }
+
 }
 
 Triangulation::Triangulation()
@@ -631,53 +1169,1417 @@ Triangulation::~Triangulation()
 
 
 VtxIx insertVertex(Triangulation& T, const Pos& pos)
+{
+  return insertVertexFrom(T, pos, 0);
+}
+
+bool insertConstraint(Triangulation& T, VtxIx a, VtxIx b)
+{
+  assert(a < T.vtxCount && b < T.vtxCount);
+  if (a == b) return true;
+
+  std::vector<HeIx> crossed;
+  std::vector<HeIx> created;
+
+  // Reject the segment up front if it crosses an existing constraint, flips
+  // never touch constrained edges so this holds through the insertion.
+  HeIx start = vertexHalfEdge(T, a, 0);
+  HeIx he = start;
+  for (VtxIx v = a; v != b;) {
+    crossed.clear();
+    v = walkSegment(T, crossed, he, b);
+    for (HeIx e : crossed) {
+      if (isConstrained(T, e)) return false;
+    }
+    if (crossed.empty() && vertex(T, he) != v) he = next(T, he);
+  }
+
+  he = start;
+  for (VtxIx v = a; v != b;) {
+    crossed.clear();
+    VtxIx c = walkSegment(T, crossed, he, b);
+
+    if (crossed.empty()) {
+      markConstrained(T, he);
+      if (vertex(T, he) == v) he = next(T, he);
+    }
+    else {
+      created.clear();
+      flipOutCrossings(T, crossed, created, v, c);
+
+      HeIx k = NoIx;
+      for (HeIx e : created) {
+        VtxIx e0 = vertex(T, e);
+        VtxIx e1 = vertex(T, next(T, e));
+        if ((e0 == v && e1 == c) || (e0 == c && e1 == v)) {
+          markConstrained(T, e);
+          k = e0 == v ? e : twin(T, e);
+        }
+      }
+      assert(k != NoIx);
+      recursiveDelaunaySwap(T, created);
+
+      // k is never flipped, so its successor still leaves c.
+      he = next(T, k);
+    }
+    v = c;
+  }
+  return true;
+}
+
+namespace {
+
+  // Shares chunks not written since the previous snapshot and copies the rest.
+  template<typename Item>
+  void publishChunks(std::vector<std::shared_ptr<const Item[]>>& chunks,
+                     const std::vector<std::shared_ptr<const Item[]>>* prev,
+                     std::vector<uint8_t>& dirty, const Item* items, uint32_t count)
+  {
+    size_t chunkCount = (size_t(count) + ChunkSize - 1) >> ChunkShift;
+    assert(chunkCount <= dirty.size());
+
+    chunks.resize(chunkCount);
+    for (size_t c = 0; c < chunkCount; c++) {
+      if (prev && c < prev->size() && !dirty[c]) {
+        chunks[c] = (*prev)[c];
+        continue;
+      }
+      size_t first = c << ChunkShift;
+      size_t n = std::min(size_t(ChunkSize), count - first);
+      std::shared_ptr<Item[]> chunk(new Item[ChunkSize]);
+      std::copy(items + first, items + first + n, chunk.get());
+      chunks[c] = std::move(chunk);
+      dirty[c] = 0;
+    }
+  }
+
+}
+
+void publishSnapshot(Triangulation& T)
+{
+  // Only the writer replaces the pointer, so it can be read without the lock.
+  std::shared_ptr<const TriangulationSnapshot> prev = T.snapshot;
+
+  std::shared_ptr<TriangulationSnapshot> S = std::make_shared<TriangulationSnapshot>();
+  S->vtxCount = T.vtxCount;
+  S->heCount = T.heCount;
+  S->version = prev ? prev->version + 1 : 1;
+  publishChunks(S->vtxChunks, prev ? &prev->vtxChunks : nullptr, T.vtxDirty, T.vtx, T.vtxCount);
+  publishChunks(S->heChunks, prev ? &prev->heChunks : nullptr, T.heDirty, T.he, T.heCount);
+
+  {
+    std::lock_guard<std::mutex> lock(T.snapshotLock);
+    T.snapshot = std::move(S);
+  }
+}
+
+std::shared_ptr<const TriangulationSnapshot> acquireSnapshot(const Triangulation& T)
+{
+  std::lock_guard<std::mutex> lock(T.snapshotLock);
+  return T.snapshot;
+}
+
+HeIx findTriangle(const TriangulationSnapshot& S, const Pos& pos, HeIx startingPoint)
 {
   bool inside[3] = {};
+  return findContainingTriangle(S, inside, pos, startingPoint);
+}
 
-  HeIx he = findContainingTriangle(T, inside, pos, 0);
-  if (he == NoIx) return NoIx;
+namespace {
 
-  size_t insideCase = (inside[0] ? 1 : 0) + (inside[1] ? 2 : 0) + (inside[2] ? 4 : 0);
-  switch (insideCase) {
+  template<typename Item>
+  bool lessItem(const Item& a, const Item& b)
+  {
+    return std::lexicographical_compare(std::begin(a.vtx), std::end(a.vtx), std::begin(b.vtx), std::end(b.vtx));
+  }
 
-  // Point on three edges boundary => degenerate triangle.
-  case 0b000:
-    assert(false && "Hit degenerate triangle");
-    return NoIx;
+  // Removes entries present in both lists one for one, leaving the net change.
+  template<typename Item>
+  void cancelChanges(std::vector<Item>& destroyed, std::vector<Item>& created)
+  {
+    std::sort(destroyed.begin(), destroyed.end(), lessItem<Item>);
+    std::sort(created.begin(), created.end(), lessItem<Item>);
+
+    size_t i = 0, j = 0, di = 0, cj = 0;
+    while (i < destroyed.size() && j < created.size()) {
+      if (lessItem(destroyed[i], created[j])) destroyed[di++] = destroyed[i++];
+      else if (lessItem(created[j], destroyed[i])) created[cj++] = created[j++];
+      else { i++; j++; }
+    }
+    while (i < destroyed.size()) destroyed[di++] = destroyed[i++];
+    while (j < created.size()) created[cj++] = created[j++];
+    destroyed.resize(di);
+    created.resize(cj);
+  }
 
-  // Point on two edges => lies on a corner
-  case 0b001: he = next(T, he); [[fallthrough]];
-  case 0b100: he = next(T, he); [[fallthrough]];
-  case 0b010: {
-    VtxIx v = vertex(T, he);
-    assert(T.vtx[v].pos.x == pos.x && T.vtx[v].pos.y == pos.y);
-    return v;
+}
+
+void drainJournal(Triangulation& T, TriangulationDelta& delta)
+{
+  std::swap(delta, T.journal);
+  T.journal.destroyedTriangles.clear();
+  T.journal.createdTriangles.clear();
+  T.journal.destroyedEdges.clear();
+  T.journal.createdEdges.clear();
+
+  cancelChanges(delta.destroyedTriangles, delta.createdTriangles);
+  cancelChanges(delta.destroyedEdges, delta.createdEdges);
+}
+
+namespace {
+
+  // -------------------------------------------------------------------------
+  //
+  // Scattered-data interpolation onto grids
+
+  constexpr uint32_t InterpolationBandRows = 16;
+
+  struct InterpolationContext
+  {
+    const Triangulation& T;
+    float* out;
+    const Grid& grid;
+    const float* values;
+    Interpolation method;
+    std::atomic<uint32_t> nextBand = 0;
+  };
+
+  struct NaturalNeighbourScratch
+  {
+    std::vector<HeIx> cavity;
+    std::vector<HeIx> todo;
+    std::vector<double> center;
+    std::vector<VtxIx> nbrVtx;
+    std::vector<double> nbrWeight;
+  };
+
+  Pos gridPos(const Grid& grid, uint32_t i, uint32_t j)
+  {
+    return Pos{
+      .x = grid.origin.x + i * grid.stepX,
+      .y = grid.origin.y + j * grid.stepY
+    };
   }
 
-  // Point on one edge => lies in the interior of an edge
-  case 0b011: he = next(T, he); [[fallthrough]];
-  case 0b101: he = next(T, he); [[fallthrough]];
-  case 0b110: {
-    const Pos& a = T.vtx[vertex(T, he)].pos;
-    const Pos& b = T.vtx[vertex(T, next(T, he))].pos;
-    assert(areaSign(a, b, pos) == 0);
+  bool insideTriangle(const Triangulation& T, HeIx he0, const Pos& pos)
+  {
+    HeIx he1 = next(T, he0);
+    HeIx he2 = next(T, he1);
+    const Pos& p0 = T.vtx[vertex(T, he0)].pos;
+    const Pos& p1 = T.vtx[vertex(T, he1)].pos;
+    const Pos& p2 = T.vtx[vertex(T, he2)].pos;
+    return 0 <= areaSign(p0, p1, pos) && 0 <= areaSign(p1, p2, pos) && 0 <= areaSign(p2, p0, pos);
+  }
 
-    VtxIx v = allocVtx(T);
-    T.vtx[v].pos = pos;
-    splitEdge(T, he, v);
-    return v;
+  // The grid row intersected with a triangle is a single interval, so
+  // starting from a sample known to be inside, gallop and then bisect to the
+  // last sample inside. Costs O(log span) exact predicate evaluations.
+  uint32_t spanEnd(const Triangulation& T, const Grid& grid, HeIx he, uint32_t i0, uint32_t j)
+  {
+    uint32_t lo = i0;                   // Known inside
+    uint32_t hi = grid.width;           // Known outside or past the end
+    for (uint32_t step = 1; lo + step < hi; step *= 2) {
+      if (!insideTriangle(T, he, gridPos(grid, lo + step, j))) {
+        hi = lo + step;
+        break;
+      }
+      lo = lo + step;
+    }
+    while (lo + 1 < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (insideTriangle(T, he, gridPos(grid, mid, j))) lo = mid;
+      else hi = mid;
+    }
+    return hi;
+  }
+
+  // Straight-line loop over the span so the compiler can vectorize it.
+  void fillLinearSpan(float* dst, uint32_t n, double v0, double dv)
+  {
+    for (uint32_t i = 0; i < n; i++) {
+      dst[i] = float(v0 + dv * double(i));
+    }
+  }
+
+  void linearSpan(const InterpolationContext& ctx, float* row, HeIx he0, uint32_t i0, uint32_t i1, uint32_t j)
+  {
+    const Triangulation& T = ctx.T;
+    HeIx he1 = next(T, he0);
+    HeIx he2 = next(T, he1);
+    VtxIx ia = vertex(T, he0);
+    VtxIx ib = vertex(T, he1);
+    VtxIx ic = vertex(T, he2);
+    const Pos& a = T.vtx[ia].pos;
+    const Pos& b = T.vtx[ib].pos;
+    const Pos& c = T.vtx[ic].pos;
+
+    double e1x = double(b.x) - double(a.x);
+    double e1y = double(b.y) - double(a.y);
+    double e2x = double(c.x) - double(a.x);
+    double e2y = double(c.y) - double(a.y);
+    double det = e1x * e2y - e1y * e2x;
+    assert(det != 0.0);
+
+    double fa = ctx.values[ia];
+    double d1 = ctx.values[ib] - fa;
+    double d2 = ctx.values[ic] - fa;
+    double gx = (d1 * e2y - d2 * e1y) / det;
+    double gy = (d2 * e1x - d1 * e2x) / det;
+
+    Pos p = gridPos(ctx.grid, i0, j);
+    double v0 = fa + gx * (double(p.x) - double(a.x)) + gy * (double(p.y) - double(a.y));
+    fillLinearSpan(row + i0, i1 - i0, v0, gx * double(ctx.grid.stepX));
+  }
+
+  // Circumcenter of (0, a, b), where a and b are relative to the query point.
+  void circumcenter(double& ux, double& uy, double ax, double ay, double bx, double by)
+  {
+    double d = 2.0 * (ax * by - ay * bx);
+    double la = ax * ax + ay * ay;
+    double lb = bx * bx + by * by;
+    ux = (by * la - ay * lb) / d;
+    uy = (ax * lb - bx * la) / d;
+  }
+
+  void relativePos(double& x, double& y, const Triangulation& T, HeIx he, const Pos& pos)
+  {
+    const Pos& p = T.vtx[vertex(T, he)].pos;
+    x = double(p.x) - double(pos.x);
+    y = double(p.y) - double(pos.y);
+  }
+
+  // Position of the triangle of he in cavity, or cavity.size() if absent.
+  size_t cavityIndex(const Triangulation& T, const std::vector<HeIx>& cavity, HeIx he)
+  {
+    if (he == NoIx) return cavity.size();
+    return std::find(cavity.begin(), cavity.end(), triangleKey(T, he)) - cavity.begin();
+  }
+
+  // Sibson coordinates by Watson's method: the Bowyer-Watson cavity of pos
+  // is found with exact in-circle tests without modifying the triangulation.
+  // The area pos would steal from a cavity vertex a is bounded by the old
+  // circumcenters of the cavity triangles around a and by the new ones of pos
+  // with the two cavity-boundary edges at a, so it is summed per boundary
+  // edge. Pos lies strictly inside the cavity, so no new circumcenter
+  // degenerates, also when pos is on an interior edge. On a hull edge the
+  // cell of pos is unbounded and the coordinates reduce to linear
+  // interpolation along that edge.
+  float naturalNeighbourValue(const InterpolationContext& ctx, NaturalNeighbourScratch& scratch, HeIx he, const Pos& pos)
+  {
+    const Triangulation& T = ctx.T;
+
+    for (size_t k = 0; k < 3; k++, he = next(T, he)) {
+      VtxIx a = vertex(T, he);
+      VtxIx b = vertex(T, next(T, he));
+      const Pos& pa = T.vtx[a].pos;
+      const Pos& pb = T.vtx[b].pos;
+      if (pa.x == pos.x && pa.y == pos.y) return ctx.values[a];
+
+      if (twin(T, he) == NoIx && areaSign(pa, pb, pos) == 0) {
+        double dx = double(pb.x) - double(pa.x);
+        double dy = double(pb.y) - double(pa.y);
+        double s = ((double(pos.x) - double(pa.x)) * dx + (double(pos.y) - double(pa.y)) * dy) / (dx * dx + dy * dy);
+        return float(ctx.values[a] + s * (double(ctx.values[b]) - double(ctx.values[a])));
+      }
+    }
+
+    scratch.center.clear();
+    scratch.nbrVtx.clear();
+    scratch.nbrWeight.clear();
+    bowyerWatsonCavity(T, scratch.cavity, scratch.todo, he, pos, [](HeIx) { return false; });
+
+    // Circumcenters of the cavity triangles relative to pos, as x, y pairs
+    // in cavity order.
+    for (HeIx t : scratch.cavity) {
+      double x0, y0, x1, y1, x2, y2;
+      relativePos(x0, y0, T, t, pos);
+      relativePos(x1, y1, T, next(T, t), pos);
+      relativePos(x2, y2, T, next(T, next(T, t)), pos);
+
+      double cx, cy;
+      circumcenter(cx, cy, x1 - x0, y1 - y0, x2 - x0, y2 - y0);
+      scratch.center.push_back(cx + x0);
+      scratch.center.push_back(cy + y0);
+    }
+
+    // For each boundary edge a->b, walk around a through the cavity to the
+    // boundary edge c->a, tracing the stolen region from the new circumcenter
+    // of (pos, a, b) over the old ones to the new one of (pos, c, a). The two
+    // new ones lie on the bisector of a and pos, as does the midpoint used
+    // as the shoelace origin, so the closing term vanishes.
+    for (size_t i = 0; i < scratch.cavity.size(); i++) {
+      HeIx h = scratch.cavity[i];
+      for (size_t k = 0; k < 3; k++, h = next(T, h)) {
+        if (cavityIndex(T, scratch.cavity, twin(T, h)) != scratch.cavity.size()) continue;
+
+        double ax, ay, bx, by;
+        relativePos(ax, ay, T, h, pos);
+        relativePos(bx, by, T, next(T, h), pos);
+        double mx = 0.5 * ax;
+        double my = 0.5 * ay;
+
+        double gx, gy;
+        circumcenter(gx, gy, ax, ay, bx, by);
+
+        double area = 0.0;
+        HeIx e = h;
+        size_t c = i;
+        while (true) {
+          double cx = scratch.center[2 * c];
+          double cy = scratch.center[2 * c + 1];
+          area += (gx - mx) * (cy - my) - (gy - my) * (cx - mx);
+          gx = cx;
+          gy = cy;
+
+          HeIx in = next(T, next(T, e));
+          c = cavityIndex(T, scratch.cavity, twin(T, in));
+          if (c == scratch.cavity.size()) {
+            relativePos(bx, by, T, in, pos);
+            circumcenter(cx, cy, bx, by, ax, ay);
+            area += (gx - mx) * (cy - my) - (gy - my) * (cx - mx);
+            break;
+          }
+          e = twin(T, in);
+        }
+
+        VtxIx v = vertex(T, h);
+        size_t n = 0;
+        while (n < scratch.nbrVtx.size() && scratch.nbrVtx[n] != v) n++;
+        if (n == scratch.nbrVtx.size()) {
+          scratch.nbrVtx.push_back(v);
+          scratch.nbrWeight.push_back(0.0);
+        }
+        scratch.nbrWeight[n] += area;
+      }
+    }
+
+    double sum = 0.0;
+    double acc = 0.0;
+    for (size_t n = 0; n < scratch.nbrVtx.size(); n++) {
+      sum += scratch.nbrWeight[n];
+      acc += scratch.nbrWeight[n] * ctx.values[scratch.nbrVtx[n]];
+    }
+    assert(0.0 < sum);
+    return float(acc / sum);
+  }
+
+  void interpolateRow(const InterpolationContext& ctx, NaturalNeighbourScratch& scratch, HeIx& rowStart, uint32_t j)
+  {
+    const Triangulation& T = ctx.T;
+    const Grid& grid = ctx.grid;
+    float* row = ctx.out + size_t(j) * grid.width;
+
+    bool inside[3] = {};
+    HeIx he = rowStart;
+    for (uint32_t i = 0; i < grid.width;) {
+      Pos pos = gridPos(grid, i, j);
+      he = findContainingTriangle(T, inside, pos, he);
+      if (i == 0) rowStart = he;
+
+      uint32_t end = spanEnd(T, grid, he, i, j);
+
+      if (ctx.method == Interpolation::NaturalNeighbour) {
+        for (; i < end; i++) {
+          pos = gridPos(grid, i, j);
+          he = findContainingTriangle(T, inside, pos, he);
+          row[i] = naturalNeighbourValue(ctx, scratch, he, pos);
+        }
+      }
+      else {
+        linearSpan(ctx, row, he, i, end, j);
+        i = end;
+      }
+    }
+  }
+
+  void interpolateWorker(InterpolationContext* ctx)
+  {
+    NaturalNeighbourScratch scratch;
+    uint32_t bandCount = (ctx->grid.height + InterpolationBandRows - 1) / InterpolationBandRows;
+
+    HeIx rowStart = 0;
+    for (uint32_t band = ctx->nextBand++; band < bandCount; band = ctx->nextBand++) {
+      uint32_t j0 = band * InterpolationBandRows;
+      uint32_t j1 = std::min(ctx->grid.height, j0 + InterpolationBandRows);
+      for (uint32_t j = j0; j < j1; j++) {
+        interpolateRow(*ctx, scratch, rowStart, j);
+      }
+    }
+  }
+
+}
+
+void interpolateGrid(const Triangulation& T, float* out, const Grid& grid, const float* values, Interpolation method, unsigned threadCount)
+{
+  if (grid.width == 0 || grid.height == 0) return;
+  assert(uint64_t(grid.origin.x) + uint64_t(grid.width - 1) * grid.stepX <= NoIx);
+  assert(uint64_t(grid.origin.y) + uint64_t(grid.height - 1) * grid.stepY <= NoIx);
+
+  InterpolationContext ctx{
+    .T = T,
+    .out = out,
+    .grid = grid,
+    .values = values,
+    .method = method
+  };
+
+  uint32_t bandCount = (grid.height + InterpolationBandRows - 1) / InterpolationBandRows;
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threadCount = std::min(threadCount, bandCount);
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < threadCount; i++) {
+    threads.emplace_back(interpolateWorker, &ctx);
+  }
+  interpolateWorker(&ctx);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+namespace {
+
+  // -------------------------------------------------------------------------
+  //
+  // Greedy-insertion heightmap simplification
+
+  struct RefineCandidate
+  {
+    float error;
+    uint32_t stamp;
+    HeIx key;
+    uint32_t i;
+    uint32_t j;
+
+    bool operator<(const RefineCandidate& other) const { return error < other.error; }
+  };
+
+  struct RefineContext
+  {
+    Triangulation& T;
+    std::vector<float>& vtxHeights;
+    const Grid& grid;
+    const float* heights;
+    std::vector<uint8_t> inserted{};              // Samples that are vertices
+    std::vector<uint32_t> stamps{};               // Per half-edge, bumped when its triangle changes
+    std::priority_queue<RefineCandidate> queue{}; // Stale entries are skipped when popped
+  };
+
+  // Maximum of |heights - (v0 + dv*i)| over the span, vertices excluded.
+  // Non-negative floats order like their bit patterns, so vertices are
+  // masked to zero and the maximum is taken over integers, which unlike a
+  // float maximum vectorizes without fast-math.
+  float maxSpanError(const float* heights, const uint8_t* inserted, uint32_t n, double v0, double dv)
+  {
+    uint32_t rv = 0;
+    for (uint32_t i = 0; i < n; i++) {
+      float e = std::fabs(heights[i] - float(v0 + dv * double(i)));
+      uint32_t bits = std::bit_cast<uint32_t>(e) & (uint32_t(inserted[i]) - 1u);
+      rv = std::max(rv, bits);
+    }
+    return std::bit_cast<float>(rv);
+  }
+
+  // Range of sample columns of row j inside the triangle. A floating-point
+  // estimate from the edge intersections is nudged into place with exact
+  // inside tests, so samples on edges belong to both neighbours.
+  bool rowRange(const Triangulation& T, const Grid& grid, HeIx he, uint32_t j, uint32_t& i0, uint32_t& i1)
+  {
+    const Pos* p[3];
+    for (size_t k = 0; k < 3; k++, he = next(T, he)) {
+      p[k] = &T.vtx[vertex(T, he)].pos;
+    }
+
+    double y = double(grid.origin.y) + double(j) * grid.stepY;
+    double xl = HUGE_VAL;
+    double xr = -HUGE_VAL;
+    for (size_t k = 0; k < 3; k++) {
+      const Pos& a = *p[k];
+      const Pos& b = *p[k == 2 ? 0 : k + 1];
+      if ((y < a.y && y < b.y) || (a.y < y && b.y < y)) continue;
+      if (a.y == b.y) {
+        xl = std::min(xl, double(std::min(a.x, b.x)));
+        xr = std::max(xr, double(std::max(a.x, b.x)));
+      }
+      else {
+        double x = double(a.x) + (y - a.y) * (double(b.x) - double(a.x)) / (double(b.y) - double(a.y));
+        xl = std::min(xl, x);
+        xr = std::max(xr, x);
+      }
+    }
+    if (xr < xl) return false;
+
+    double fl = std::ceil((xl - grid.origin.x) / grid.stepX);
+    double fr = std::floor((xr - grid.origin.x) / grid.stepX);
+    int64_t l = int64_t(std::max(0.0, std::min(fl, double(grid.width - 1))));
+    int64_t r = int64_t(std::max(0.0, std::min(fr, double(grid.width - 1))));
+
+    while (0 < l && insideTriangle(T, he, gridPos(grid, uint32_t(l - 1), j))) l--;
+    while (l <= r && !insideTriangle(T, he, gridPos(grid, uint32_t(l), j))) l++;
+    while (r + 1 < grid.width && insideTriangle(T, he, gridPos(grid, uint32_t(r + 1), j))) r++;
+    while (l <= r && !insideTriangle(T, he, gridPos(grid, uint32_t(r), j))) r--;
+    if (r < l) return false;
+
+    i0 = uint32_t(l);
+    i1 = uint32_t(r + 1);
+    return true;
+  }
+
+  void scanTriangle(RefineContext& ctx, HeIx he)
+  {
+    const Triangulation& T = ctx.T;
+    const Grid& grid = ctx.grid;
+
+    HeIx key = triangleKey(T, he);
+    HeIx he1 = next(T, he);
+    HeIx he2 = next(T, he1);
+    VtxIx ia = vertex(T, he);
+    VtxIx ib = vertex(T, he1);
+    VtxIx ic = vertex(T, he2);
+    const Pos& a = T.vtx[ia].pos;
+    const Pos& b = T.vtx[ib].pos;
+    const Pos& c = T.vtx[ic].pos;
+
+    double e1x = double(b.x) - double(a.x);
+    double e1y = double(b.y) - double(a.y);
+    double e2x = double(c.x) - double(a.x);
+    double e2y = double(c.y) - double(a.y);
+    double det = e1x * e2y - e1y * e2x;
+
+    double fa = ctx.vtxHeights[ia];
+    double d1 = ctx.vtxHeights[ib] - fa;
+    double d2 = ctx.vtxHeights[ic] - fa;
+    double gx = (d1 * e2y - d2 * e1y) / det;
+    double gy = (d2 * e1x - d1 * e2x) / det;
+
+    double ymin = std::min(a.y, std::min(b.y, c.y));
+    double ymax = std::max(a.y, std::max(b.y, c.y));
+    double fj0 = std::ceil((ymin - grid.origin.y) / grid.stepY);
+    double fj1 = std::floor((ymax - grid.origin.y) / grid.stepY);
+    if (fj1 < 0.0 || double(grid.height - 1) < fj0) return;
+    uint32_t j0 = uint32_t(std::max(0.0, fj0));
+    uint32_t j1 = uint32_t(std::min(double(grid.height - 1), fj1));
+
+    RefineCandidate best{ .error = 0.f, .stamp = ctx.stamps[key], .key = key, .i = 0, .j = 0 };
+    for (uint32_t j = j0; j <= j1; j++) {
+      uint32_t i0, i1;
+      if (!rowRange(T, grid, he, j, i0, i1)) continue;
+
+      size_t o = size_t(j) * grid.width;
+      Pos p = gridPos(grid, i0, j);
+      double v0 = fa + gx * (double(p.x) - double(a.x)) + gy * (double(p.y) - double(a.y));
+      double dv = gx * double(grid.stepX);
+
+      float e = maxSpanError(ctx.heights + o + i0, ctx.inserted.data() + o + i0, i1 - i0, v0, dv);
+      if (e <= best.error) continue;
+
+      for (uint32_t i = i0; i < i1; i++) {
+        if (ctx.inserted[o + i]) continue;
+        float ei = std::fabs(ctx.heights[o + i] - float(v0 + dv * double(i - i0)));
+        if (best.error < ei) {
+          best.error = ei;
+          best.i = i;
+          best.j = j;
+        }
+      }
+    }
+
+    if (0.f < best.error) {
+      ctx.queue.push(best);
+    }
+  }
+
+}
+
+void refineHeightmap(Triangulation& T, std::vector<float>& vtxHeights, const Grid& grid, const float* heights,
+                     float maxError, uint32_t maxVertices)
+{
+  assert(T.vtxCount == 4 && "Expected a fresh triangulation");
+  if (grid.width == 0 || grid.height == 0) return;
+  assert(uint64_t(grid.origin.x) + uint64_t(grid.width - 1) * grid.stepX <= NoIx);
+  assert(uint64_t(grid.origin.y) + uint64_t(grid.height - 1) * grid.stepY <= NoIx);
+
+  RefineContext ctx{
+    .T = T,
+    .vtxHeights = vtxHeights,
+    .grid = grid,
+    .heights = heights
+  };
+  ctx.inserted.resize(size_t(grid.width) * grid.height);
+
+  // The bounding corners take the height of the nearest grid corner.
+  vtxHeights.resize(T.vtxCount);
+  for (VtxIx v = 0; v < T.vtxCount; v++) {
+    const Pos& p = T.vtx[v].pos;
+    uint32_t i = p.x <= grid.origin.x ? 0 : grid.width - 1;
+    uint32_t j = p.y <= grid.origin.y ? 0 : grid.height - 1;
+    vtxHeights[v] = heights[size_t(j) * grid.width + i];
+
+    Pos q = gridPos(grid, i, j);
+    if (q.x == p.x && q.y == p.y) ctx.inserted[size_t(j) * grid.width + i] = 1;
   }
 
-  // Point in the interior of the triangle
-  case 0b111: {
-    VtxIx v = allocVtx(T);
-    T.vtx[v].pos = pos;
-    splitTriangle(T, he, v);
+  ctx.stamps.resize(T.heCount);
+  for (HeIx he = 0; he < T.heCount; he++) {
+    if (triangleKey(T, he) == he) scanTriangle(ctx, he);
+  }
+
+  std::vector<HeIx> star;
+  while (!ctx.queue.empty() && T.vtxCount < maxVertices) {
+    RefineCandidate c = ctx.queue.top();
+    ctx.queue.pop();
+    if (c.error <= maxError) break;
+    if (ctx.stamps[c.key] != c.stamp) continue;
+
+    size_t s = size_t(c.j) * grid.width + c.i;
+    VtxIx v = insertVertexFrom(T, gridPos(grid, c.i, c.j), c.key);
+    assert(v + 1 == T.vtxCount);
+    vtxHeights.push_back(heights[s]);
+    ctx.inserted[s] = 1;
+
+    // Every triangle created by a Delaunay insertion is incident to the new
+    // vertex, and every half-edge of a destroyed triangle is reused by one of
+    // them, so bumping the stamps of the star invalidates all stale entries.
+    ctx.stamps.resize(T.heCount);
+    star.clear();
+    vertexStar(T, star, vertexHalfEdge(T, v, c.key));
+    for (HeIx he : star) {
+      ctx.stamps[he]++;
+      ctx.stamps[next(T, he)]++;
+      ctx.stamps[next(T, next(T, he))]++;
+    }
+    for (HeIx he : star) {
+      scanTriangle(ctx, he);
+    }
+  }
+}
+
+namespace {
+
+  // -------------------------------------------------------------------------
+  //
+  // Euclidean minimum spanning tree
+
+  constexpr size_t KruskalBaseCase = 1024;
+
+  struct WeightedEdge
+  {
+    Int<2> lengthSq;  // 65 bits unsigned
+    VtxIx a;
+    VtxIx b;
+  };
+
+  struct SpanningTreeContext
+  {
+    std::vector<Edge>& mst;
+    std::vector<ClusterMerge>& dendrogram;
+    std::vector<VtxIx> parent{};      // Union-find forest over vertices
+    std::vector<uint32_t> size{};     // Cluster size at roots
+    std::vector<uint32_t> cluster{};  // Dendrogram cluster id at roots
+  };
+
+  VtxIx findRoot(SpanningTreeContext& ctx, VtxIx v)
+  {
+    while (ctx.parent[v] != v) {
+      ctx.parent[v] = ctx.parent[ctx.parent[v]];
+      v = ctx.parent[v];
+    }
     return v;
   }
 
-  default:
-    assert(false);
+  bool lessLength(const WeightedEdge& x, const WeightedEdge& y)
+  {
+    return less(x.lengthSq, y.lengthSq);
+  }
+
+  void kruskal(SpanningTreeContext& ctx, WeightedEdge* first, WeightedEdge* last)
+  {
+    std::sort(first, last, lessLength);
+    for (WeightedEdge* e = first; e != last; e++) {
+      VtxIx ra = findRoot(ctx, e->a);
+      VtxIx rb = findRoot(ctx, e->b);
+      if (ra == rb) continue;
+      if (ctx.size[ra] < ctx.size[rb]) std::swap(ra, rb);
+
+      uint32_t merged = uint32_t(ctx.parent.size() + ctx.dendrogram.size());
+      ctx.mst.push_back({ .vtx = { std::min(e->a, e->b), std::max(e->a, e->b) } });
+      ctx.dendrogram.push_back({
+        .a = ctx.cluster[ra],
+        .b = ctx.cluster[rb],
+        .length = std::sqrt(toDouble(e->lengthSq)),
+        .size = ctx.size[ra] + ctx.size[rb]
+      });
+
+      ctx.parent[rb] = ra;
+      ctx.size[ra] += ctx.size[rb];
+      ctx.cluster[ra] = merged;
+    }
+  }
+
+  // Filter-Kruskal: partition around a pivot length, solve the short side,
+  // then drop long edges whose endpoints are already connected before
+  // recursing. Most long edges of a Delaunay graph get filtered, so the
+  // bulk of them is never sorted.
+  void filterKruskal(SpanningTreeContext& ctx, WeightedEdge* first, WeightedEdge* last)
+  {
+    if (size_t(last - first) <= KruskalBaseCase) {
+      kruskal(ctx, first, last);
+      return;
+    }
+
+    WeightedEdge* a = first;
+    WeightedEdge* b = first + (last - first) / 2;
+    WeightedEdge* c = last - 1;
+    if (lessLength(*b, *a)) std::swap(a, b);
+    if (lessLength(*c, *b)) std::swap(b, c);
+    if (lessLength(*b, *a)) std::swap(a, b);
+    Int<2> pivot = b->lengthSq;
+
+    WeightedEdge* mid = std::partition(first, last, [&](const WeightedEdge& e) { return less(e.lengthSq, pivot); });
+    if (mid == first) {
+      // All edges at least as long as the median of three, typically many
+      // equal lengths, so partitioning makes no progress.
+      kruskal(ctx, first, last);
+      return;
+    }
+
+    filterKruskal(ctx, first, mid);
+    WeightedEdge* end = std::partition(mid, last, [&](const WeightedEdge& e) { return findRoot(ctx, e.a) != findRoot(ctx, e.b); });
+    filterKruskal(ctx, mid, end);
+  }
+
+}
+
+void spanningTree(const Triangulation& T, std::vector<Edge>& mst, std::vector<ClusterMerge>& dendrogram)
+{
+  mst.clear();
+  dendrogram.clear();
+
+  // Each edge once, skipping the four bounding corners.
+  std::vector<WeightedEdge> edges;
+  for (HeIx i = 0; i < T.heCount; i++) {
+    const HalfEdge& he = T.he[i];
+    if (he.twin != NoIx && he.twin < i) continue;
+
+    VtxIx a = he.vtx;
+    VtxIx b = T.he[he.nxt].vtx;
+    if (isBoundingCorner(a) || isBoundingCorner(b)) continue;
+
+    const Pos& pa = T.vtx[a].pos;
+    const Pos& pb = T.vtx[b].pos;
+    uint64_t dx = pa.x < pb.x ? pb.x - pa.x : pa.x - pb.x;  // 32 bits
+    uint64_t dy = pa.y < pb.y ? pb.y - pa.y : pa.y - pb.y;
+    Int<2> dx2{ dx * dx };                                    // 64 bits extended to 128
+    Int<2> dy2{ dy * dy };
+    edges.push_back({ .lengthSq = add(dx2, dy2), .a = a, .b = b });
+  }
+
+  SpanningTreeContext ctx{
+    .mst = mst,
+    .dendrogram = dendrogram
+  };
+  ctx.parent.resize(T.vtxCount);
+  ctx.size.resize(T.vtxCount, 1);
+  ctx.cluster.resize(T.vtxCount);
+  for (VtxIx v = 0; v < T.vtxCount; v++) {
+    ctx.parent[v] = v;
+    ctx.cluster[v] = v;
+  }
+
+  filterKruskal(ctx, edges.data(), edges.data() + edges.size());
+}
+
+namespace {
+
+  // -------------------------------------------------------------------------
+  //
+  // Alpha complex
+
+  // Non-negative rational num / den.
+  struct Ratio
+  {
+    Int<4> num;
+    Int<4> den;
+  };
+
+  bool lessRatio(const Ratio& x, const Ratio& y)
+  {
+    return less(muls(x.num, y.den), muls(y.num, x.den));  // 329 bits
+  }
+
+  double toDouble(const Ratio& x)
+  {
+    return toDouble(x.num) / toDouble(x.den);
+  }
+
+  // Squared circumradius of a triangle, |a|^2 |b|^2 |c|^2 / (4 cross(a, b)^2)
+  // for edge vectors a, b and c.
+  Ratio circumradiusSq(const Pos& p0, const Pos& p1, const Pos& p2)
+  {
+    Int<2> ax = sext<2>(int64_t(p1.x) - int64_t(p0.x));  // 33 bits signed
+    Int<2> ay = sext<2>(int64_t(p1.y) - int64_t(p0.y));
+    Int<2> bx = sext<2>(int64_t(p2.x) - int64_t(p0.x));
+    Int<2> by = sext<2>(int64_t(p2.y) - int64_t(p0.y));
+    Int<2> cx = sext<2>(int64_t(p2.x) - int64_t(p1.x));
+    Int<2> cy = sext<2>(int64_t(p2.y) - int64_t(p1.y));
+
+    Int<2> la = add(trunc<2>(muls(ax, ax)), trunc<2>(muls(ay, ay)));  // 65 bits
+    Int<2> lb = add(trunc<2>(muls(bx, bx)), trunc<2>(muls(by, by)));
+    Int<2> lc = add(trunc<2>(muls(cx, cx)), trunc<2>(muls(cy, cy)));
+    Int<2> cross = sub(trunc<2>(muls(ax, by)), trunc<2>(muls(ay, bx)));  // 66 bits signed
+
+    Int<4> cross2 = muls(cross, cross);  // 132 bits
+    Int<4> cross4 = add(cross2, cross2);
+    return Ratio{
+      .num = trunc<4>(muls(muls(la, lb), widen<4>(lc))),  // 195 bits
+      .den = add(cross4, cross4)                          // 134 bits
+    };
+  }
+
+  struct AlphaEdgeCandidate
+  {
+    HeIx he;            // Half-edge of the triangle with the smaller circumradius
+    Ratio lo;           // Squared alpha at which the edge enters the complex
+    bool attached;      // Enters with its first triangle
+    uint32_t regular;   // Rank of that triangle, NoIx if none
+    uint32_t hi;        // Rank of the other triangle, NoIx if none
+  };
+
+}
+
+void buildAlphaComplex(const Triangulation& T, AlphaComplex& complex)
+{
+  complex.triangles.clear();
+  complex.triangleAlpha.clear();
+  complex.edges.clear();
+  complex.vertices.clear();
+  complex.vertexAlpha.clear();
+
+  // Triangles touching the bounding corners are never part of the complex.
+  std::vector<Ratio> radii;
+  std::vector<uint32_t> triangleOf(T.heCount, NoIx);
+  for (HeIx he = 0; he < T.heCount; he++) {
+    if (triangleKey(T, he) != he) continue;
+
+    HeIx he1 = next(T, he);
+    HeIx he2 = next(T, he1);
+    VtxIx v0 = vertex(T, he);
+    VtxIx v1 = vertex(T, he1);
+    VtxIx v2 = vertex(T, he2);
+    if (touchesBoundingCorner(T, he)) continue;
+
+    uint32_t t = uint32_t(radii.size());
+    triangleOf[he] = triangleOf[he1] = triangleOf[he2] = t;
+    radii.push_back(circumradiusSq(T.vtx[v0].pos, T.vtx[v1].pos, T.vtx[v2].pos));
+    complex.triangles.push_back(he);
+  }
+
+  // Rank triangles exactly, so that edge intervals can be ordered by rank.
+  std::vector<uint32_t> order(radii.size());
+  for (uint32_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return lessRatio(radii[a], radii[b]); });
+
+  std::vector<uint32_t> rank(radii.size());
+  std::vector<HeIx> triangles(radii.size());
+  complex.triangleAlpha.resize(radii.size());
+  for (uint32_t i = 0; i < order.size(); i++) {
+    rank[order[i]] = i;
+    triangles[i] = complex.triangles[order[i]];
+    // Rounding may break monotonicity for nearly equal radii, the running
+    // maximum keeps the array sorted for the queries' binary searches.
+    double alpha = std::sqrt(toDouble(radii[order[i]]));
+    complex.triangleAlpha[i] = 0 < i ? std::max(alpha, complex.triangleAlpha[i - 1]) : alpha;
+  }
+  std::swap(complex.triangles, triangles);
+
+  // An edge enters the complex at half its length if no apex of its
+  // triangles lies inside its diametral circle, and with its first triangle
+  // otherwise. It is on the boundary from then until both triangles are in,
+  // and singular before the first one is. Edges entering with both triangles
+  // at once, compared exactly, are never on the boundary. A vertex stops
+  // being isolated when its first edge enters.
+  std::vector<AlphaEdgeCandidate> candidates;
+  std::vector<Ratio> vertexRadii(T.vtxCount);
+  std::vector<uint8_t> connected(T.vtxCount, 0);
+  for (HeIx he = 0; he < T.heCount; he++) {
+    HeIx tw = twin(T, he);
+    if (tw != NoIx && tw < he) continue;
+
+    VtxIx a = vertex(T, he);
+    VtxIx b = vertex(T, next(T, he));
+    if (isBoundingCorner(a) || isBoundingCorner(b)) continue;
+
+    HeIx e = he;
+    uint32_t t0 = triangleOf[he];
+    uint32_t t1 = tw != NoIx ? triangleOf[tw] : NoIx;
+    if (t1 != NoIx && (t0 == NoIx || lessRatio(radii[t1], radii[t0]))) {
+      e = tw;
+      std::swap(t0, t1);
+      std::swap(a, b);
+    }
+
+    const Pos& pa = T.vtx[a].pos;
+    const Pos& pb = T.vtx[b].pos;
+    bool attached = false;
+    if (t0 != NoIx) attached = encroaches(pa, pb, T.vtx[vertex(T, next(T, next(T, e)))].pos);
+    if (t1 != NoIx) attached = attached || encroaches(pa, pb, T.vtx[vertex(T, next(T, next(T, twin(T, e))))].pos);
+
+    Ratio lo = attached ? radii[t0] : Ratio{ .num = widen<4>(lengthSq(pa, pb)), .den = sext<4>(4) };
+    for (VtxIx v : { a, b }) {
+      if (!connected[v] || lessRatio(lo, vertexRadii[v])) {
+        vertexRadii[v] = lo;
+        connected[v] = 1;
+      }
+    }
+    if (t1 != NoIx && !lessRatio(lo, radii[t1])) continue;
+
+    candidates.push_back({
+      .he = e,
+      .lo = lo,
+      .attached = attached,
+      .regular = t0 != NoIx ? rank[t0] : NoIx,
+      .hi = t1 != NoIx ? rank[t1] : NoIx
+    });
+  }
+  std::sort(candidates.begin(), candidates.end(), [](const AlphaEdgeCandidate& a, const AlphaEdgeCandidate& b) { return lessRatio(a.lo, b.lo); });
+
+  // Attached edges share the value of their triangle, and running maxima
+  // keep the arrays sorted as for the triangles.
+  complex.edges.reserve(candidates.size());
+  for (const AlphaEdgeCandidate& c : candidates) {
+    double regular = c.regular != NoIx ? complex.triangleAlpha[c.regular] : HUGE_VAL;
+    double lo = c.attached ? regular : std::min(std::sqrt(toDouble(c.lo)), regular);
+    if (!complex.edges.empty()) lo = std::max(lo, complex.edges.back().lo);
+    complex.edges.push_back({
+      .vtx = { vertex(T, c.he), vertex(T, next(T, c.he)) },
+      .lo = lo,
+      .regular = std::max(regular, lo),
+      .hi = c.hi != NoIx ? std::max(complex.triangleAlpha[c.hi], lo) : HUGE_VAL
+    });
+  }
+
+  for (VtxIx v = 0; v < T.vtxCount; v++) {
+    if (!isBoundingCorner(v)) complex.vertices.push_back(v);
+  }
+  std::sort(complex.vertices.begin(), complex.vertices.end(), [&](VtxIx a, VtxIx b) {
+    if (connected[a] != connected[b]) return connected[a] > connected[b];
+    return connected[a] && lessRatio(vertexRadii[a], vertexRadii[b]);
+  });
+  complex.vertexAlpha.resize(complex.vertices.size());
+  for (size_t i = 0; i < complex.vertices.size(); i++) {
+    VtxIx v = complex.vertices[i];
+    double alpha = connected[v] ? std::sqrt(toDouble(vertexRadii[v])) : HUGE_VAL;
+    complex.vertexAlpha[i] = 0 < i ? std::max(alpha, complex.vertexAlpha[i - 1]) : alpha;
+  }
+}
+
+size_t alphaShapeTriangles(const AlphaComplex& complex, double alpha)
+{
+  return std::upper_bound(complex.triangleAlpha.begin(), complex.triangleAlpha.end(), alpha) - complex.triangleAlpha.begin();
+}
+
+size_t alphaShapeConnected(const AlphaComplex& complex, double alpha)
+{
+  return std::upper_bound(complex.vertexAlpha.begin(), complex.vertexAlpha.end(), alpha) - complex.vertexAlpha.begin();
+}
+
+void alphaShapeBoundary(const AlphaComplex& complex, double alpha, std::vector<AlphaEdge>& boundary)
+{
+  boundary.clear();
+  for (const AlphaEdge& e : complex.edges) {
+    if (alpha < e.lo) break;
+    if (alpha < e.hi) boundary.push_back(e);
+  }
+}
+
+namespace {
+
+  // -------------------------------------------------------------------------
+  //
+  // Quality refinement
+
+  struct QualityBound
+  {
+    Int<4> sinSq;       // Squared sine of the minimum angle, scaled by 2^32
+    Int<2> doubleArea;  // Twice the maximum area
+    bool limitArea;
+  };
+
+  struct QualityCandidate
+  {
+    double ratio;       // 1 / sin^2 of the smallest angle
+    HeIx he;
+    VtxIx vtx[3];       // Vertices of he's triangle when queued
+
+    bool operator<(const QualityCandidate& other) const { return ratio < other.ratio; }
+  };
+
+  struct QualitySegment
+  {
+    HeIx he;
+    VtxIx vtx[2];
+  };
+
+  struct QualityContext
+  {
+    Triangulation& T;
+    QualityBound bound{};
+    std::priority_queue<QualityCandidate> triangles{};
+    std::vector<QualitySegment> segments{};
+    std::vector<uint8_t> outside{};   // Per half-edge, set for triangles outside the domain
+    std::vector<HeIx> star{};
+    std::vector<HeIx> cavity{};
+    std::vector<HeIx> todo{};
+  };
+
+  // Queues the triangle of he if its smallest angle or its area violates the
+  // bound. The smallest angle lies opposite the shortest edge, and its sine
+  // is cross / (|a| |b|) for the two other edges a and b.
+  void scanQuality(QualityContext& ctx, HeIx he)
+  {
+    const Triangulation& T = ctx.T;
+
+    HeIx he1 = next(T, he);
+    HeIx he2 = next(T, he1);
+    VtxIx v0 = vertex(T, he);
+    VtxIx v1 = vertex(T, he1);
+    VtxIx v2 = vertex(T, he2);
+    if (ctx.outside[he]) return;
+
+    const Pos& p0 = T.vtx[v0].pos;
+    const Pos& p1 = T.vtx[v1].pos;
+    const Pos& p2 = T.vtx[v2].pos;
+
+    Int<2> l[3] = { lengthSq(p0, p1), lengthSq(p1, p2), lengthSq(p2, p0) };
+    size_t s = less(l[1], l[0]) ? 1 : 0;
+    if (less(l[2], l[s])) s = 2;
+    Int<4> lalb = muls(l[(s + 1) % 3], l[(s + 2) % 3]);  // 130 bits
+
+    Int<2> ax = sext<2>(int64_t(p1.x) - int64_t(p0.x));
+    Int<2> ay = sext<2>(int64_t(p1.y) - int64_t(p0.y));
+    Int<2> bx = sext<2>(int64_t(p2.x) - int64_t(p0.x));
+    Int<2> by = sext<2>(int64_t(p2.y) - int64_t(p0.y));
+    Int<2> cross = sub(trunc<2>(muls(ax, by)), trunc<2>(muls(ay, bx)));  // 66 bits, positive
+    Int<4> cross2 = muls(cross, cross);
+
+    bool skinny = less(muls(cross2, sext<4>(int64_t(1) << 32)), muls(ctx.bound.sinSq, lalb));  // 164 bits
+    bool large = ctx.bound.limitArea && less(ctx.bound.doubleArea, cross);
+    if (!skinny && !large) return;
+
+    ctx.triangles.push({
+      .ratio = toDouble(lalb) / toDouble(cross2),
+      .he = he,
+      .vtx = { v0, v1, v2 }
+    });
+  }
+
+  // Queues the edge of he if it is constrained and the apex of one of its
+  // triangles inside the domain encroaches upon it.
+  void checkSegment(QualityContext& ctx, HeIx he)
+  {
+    const Triangulation& T = ctx.T;
+    if (!isConstrained(T, he)) return;
+
+    VtxIx a = vertex(T, he);
+    VtxIx b = vertex(T, next(T, he));
+    HeIx tw = twin(T, he);
+    HeIx sides[2] = { he, tw };
+    for (HeIx side : sides) {
+      if (side == NoIx || ctx.outside[side]) continue;
+      VtxIx c = vertex(T, next(T, next(T, side)));
+      if (encroaches(T.vtx[a].pos, T.vtx[b].pos, T.vtx[c].pos)) {
+        ctx.segments.push_back({ .he = he, .vtx = { a, b } });
+        return;
+      }
+    }
+  }
+
+  // Lattice point on a b closest to its midpoint, so that a split keeps the
+  // segment straight. False if a b has no lattice point in its interior.
+  bool segmentMidpoint(const Pos& a, const Pos& b, Pos& m)
+  {
+    int64_t dx = int64_t(b.x) - int64_t(a.x);
+    int64_t dy = int64_t(b.y) - int64_t(a.y);
+    int64_t g = std::gcd(dx, dy);
+    if (g < 2) return false;
+
+    m.x = uint32_t(int64_t(a.x) + dx / g * (g / 2));
+    m.y = uint32_t(int64_t(a.y) + dy / g * (g / 2));
+    return true;
+  }
+
+  // Lattice point next to the midpoint of a b on or right of the line,
+  // i.e. outside the domain for a boundary edge. False if there is none but
+  // the endpoints.
+  bool roundedMidpoint(const Pos& a, const Pos& b, Pos& m)
+  {
+    uint64_t sx = uint64_t(a.x) + b.x;
+    uint64_t sy = uint64_t(a.y) + b.y;
+    for (uint64_t i = 0; i < 4; i++) {
+      m.x = uint32_t((sx + (i & 1)) / 2);
+      m.y = uint32_t((sy + (i >> 1)) / 2);
+      if ((m.x != a.x || m.y != a.y) && (m.x != b.x || m.y != b.y) && areaSign(a, b, m) <= 0) return true;
+    }
+    return false;
+  }
+
+  // Finds a segment that pos, lying in the triangle of he, encroaches upon
+  // among those bounding its Bowyer-Watson cavity, NoIx if none.
+  HeIx encroachedSegment(QualityContext& ctx, HeIx he, const Pos& pos)
+  {
+    const Triangulation& T = ctx.T;
+
+    bowyerWatsonCavity(T, ctx.cavity, ctx.todo, he, pos, [&](HeIx e) { return isConstrained(T, e); });
+    for (HeIx t : ctx.cavity) {
+      for (size_t k = 0; k < 3; k++, t = next(T, t)) {
+        if (isConstrained(T, t) && encroaches(T.vtx[vertex(T, t)].pos, T.vtx[vertex(T, next(T, t))].pos, pos)) return t;
+      }
+    }
     return NoIx;
   }
+
+  // Constrained edges through the new vertex cut its star into sectors lying
+  // on one side of the domain boundary each. A sector takes its side from a
+  // triangle beyond its rim, which the insertion left alone, or from a
+  // bounding corner.
+  void classifyStar(QualityContext& ctx)
+  {
+    const Triangulation& T = ctx.T;
+    const std::vector<HeIx>& star = ctx.star;
+    ctx.outside.resize(T.heCount);
+
+    size_t n = star.size();
+    size_t first = 0;
+    while (first < n && !isConstrained(T, star[first])) first++;
+    if (first == n) first = 0;
+
+    for (size_t i = 0; i < n;) {
+      int side = -1;
+      size_t j = i;
+      do {
+        HeIx e = next(T, star[(first + j) % n]);
+        HeIx tw = twin(T, e);
+        if (tw == NoIx || touchesBoundingCorner(T, e)) side = 1;
+        else if (side < 0 && !isConstrained(T, e)) side = ctx.outside[tw];
+        j++;
+      } while (j < n && !isConstrained(T, star[(first + j) % n]));
+
+      for (; i < j; i++) {
+        HeIx s = star[(first + i) % n];
+        ctx.outside[s] = ctx.outside[next(T, s)] = ctx.outside[next(T, next(T, s))] = side == 1;
+      }
+    }
+  }
+
+  // The insertion of v only created triangles around it. Their edges
+  // opposite v have a new apex, and the segment halves split at v are new.
+  void queueStar(QualityContext& ctx, VtxIx v, HeIx he)
+  {
+    const Triangulation& T = ctx.T;
+
+    ctx.star.clear();
+    vertexStar(T, ctx.star, vertexHalfEdge(T, v, he));
+    classifyStar(ctx);
+    for (HeIx s : ctx.star) {
+      scanQuality(ctx, s);
+      checkSegment(ctx, s);
+      checkSegment(ctx, next(T, s));
+    }
+  }
+
+  // Inserts pos, starting the search at he. False if pos already is a vertex.
+  bool insertSteiner(QualityContext& ctx, const Pos& pos, HeIx he)
+  {
+    Triangulation& T = ctx.T;
+
+    VtxIx count = T.vtxCount;
+    VtxIx v = insertVertexFrom(T, pos, he);
+    if (v < count) return false;
+
+    queueStar(ctx, v, he);
+    return true;
+  }
+
+  // Splits the constrained edge of he close to its midpoint. Without a
+  // lattice point in its interior the edge is bent instead: the rounded
+  // midpoint is inserted on the right of he, outside the domain for a
+  // boundary edge, then the edge is flipped away and its constraint moved to
+  // the two edges through the new vertex.
+  bool splitNear(QualityContext& ctx, HeIx he)
+  {
+    Triangulation& T = ctx.T;
+
+    VtxIx a = vertex(T, he);
+    VtxIx b = vertex(T, next(T, he));
+    const Pos& pa = T.vtx[a].pos;
+    const Pos& pb = T.vtx[b].pos;
+
+    Pos m;
+    if (segmentMidpoint(pa, pb, m)) return insertSteiner(ctx, m, he);
+    if (!roundedMidpoint(pa, pb, m)) return false;
+
+    VtxIx count = T.vtxCount;
+    VtxIx v = insertVertexFrom(T, m, he);
+    if (v < count) return false;
+
+    ctx.star.clear();
+    vertexStar(T, ctx.star, vertexHalfEdge(T, v, he));
+    for (HeIx s : ctx.star) {
+      HeIx e = next(T, s);
+      HeIx tw = twin(T, e);
+      VtxIx w0 = vertex(T, e);
+      VtxIx w1 = vertex(T, next(T, e));
+      if (tw == NoIx || !((w0 == a && w1 == b) || (w0 == b && w1 == a))) continue;
+
+      const Pos& p1 = T.vtx[w1].pos;
+      const Pos& p0 = T.vtx[w0].pos;
+      const Pos& px = T.vtx[vertex(T, next(T, next(T, tw)))].pos;
+      if (areaSign(p1, m, px) <= 0 || areaSign(p0, px, m) <= 0) break;
+
+      setConstrained(T, e, false);
+      setConstrained(T, tw, false);
+      flipEdge(T, e);
+
+      ctx.star.clear();
+      vertexStar(T, ctx.star, vertexHalfEdge(T, v, he));
+      ctx.todo.clear();
+      for (HeIx r : ctx.star) {
+        VtxIx w = vertex(T, next(T, r));
+        if (w == a || w == b) markConstrained(T, r);
+        ctx.todo.push_back(next(T, r));
+      }
+      recursiveDelaunaySwap(T, ctx.todo);
+      break;
+    }
+
+    queueStar(ctx, v, he);
+    return true;
+  }
+
+}
+
+void refineQuality(Triangulation& T, double minAngle, double maxArea, uint32_t maxVertices)
+{
+  double sinAngle = std::sin(minAngle * std::numbers::pi / 180.0);
+  double doubleArea = std::floor(2.0 * maxArea);
+
+  QualityContext ctx{ .T = T };
+  ctx.bound.sinSq = sext<4>(std::llround(sinAngle * sinAngle * 4294967296.0));
+  ctx.bound.limitArea = doubleArea < 73786976294838206464.0;  // 2^66
+  if (ctx.bound.limitArea) {
+    double hi = std::floor(doubleArea / 18446744073709551616.0);
+    ctx.bound.doubleArea.word[1] = uint64_t(hi);
+    ctx.bound.doubleArea.word[0] = uint64_t(doubleArea - hi * 18446744073709551616.0);
+  }
+
+  // The domain is what markOutsideDomain leaves over, so that the boundary
+  // left by an earlier call, bent edges included, is kept. Unless constrained
+  // edges already separate it from some triangle touching a bounding corner,
+  // the triangles touching the corners are taken as the outside and the
+  // edges between them and the rest are constrained first.
+  markOutsideDomain(T, ctx.outside);
+  bool enclosed = false;
+  for (HeIx he = 0; he < T.heCount && !enclosed; he++) {
+    HeIx tw = twin(T, he);
+    enclosed = !ctx.outside[he] && tw != NoIx && touchesBoundingCorner(T, tw);
+  }
+  if (!enclosed) {
+    for (HeIx he = 0; he < T.heCount; he++) {
+      ctx.outside[he] = touchesBoundingCorner(T, he);
+    }
+    for (HeIx he = 0; he < T.heCount; he++) {
+      HeIx tw = twin(T, he);
+      if (!ctx.outside[he] && (tw == NoIx || ctx.outside[tw]) && !isConstrained(T, he)) markConstrained(T, he);
+    }
+  }
+
+  for (HeIx he = 0; he < T.heCount; he++) {
+    if (triangleKey(T, he) == he) scanQuality(ctx, he);
+    if (twin(T, he) == NoIx || he < twin(T, he)) checkSegment(ctx, he);
+  }
+
+  while (T.vtxCount < maxVertices) {
+
+    // Encroached segments go first, as in Ruppert's algorithm.
+    if (!ctx.segments.empty()) {
+      QualitySegment s = ctx.segments.back();
+      ctx.segments.pop_back();
+      if (vertex(T, s.he) != s.vtx[0] || vertex(T, next(T, s.he)) != s.vtx[1]) continue;
+
+      HeIx tw = twin(T, s.he);
+      splitNear(ctx, ctx.outside[s.he] && tw != NoIx ? tw : s.he);
+      continue;
+    }
+
+    if (ctx.triangles.empty()) break;
+    QualityCandidate c = ctx.triangles.top();
+    ctx.triangles.pop();
+
+    HeIx he1 = next(T, c.he);
+    if (vertex(T, c.he) != c.vtx[0] || vertex(T, he1) != c.vtx[1] || vertex(T, next(T, he1)) != c.vtx[2]) continue;
+
+    const Pos& p0 = T.vtx[c.vtx[0]].pos;
+    const Pos& p1 = T.vtx[c.vtx[1]].pos;
+    const Pos& p2 = T.vtx[c.vtx[2]].pos;
+    double ux, uy;
+    circumcenter(ux, uy,
+                 double(p1.x) - double(p0.x), double(p1.y) - double(p0.y),
+                 double(p2.x) - double(p0.x), double(p2.y) - double(p0.y));
+    Pos center{
+      .x = uint32_t(std::clamp(std::round(double(p0.x) + ux), 0.0, 4294967295.0)),
+      .y = uint32_t(std::clamp(std::round(double(p0.y) + uy), 0.0, 4294967295.0))
+    };
+
+    // A circumcenter behind or encroaching upon a segment, possibly on the
+    // domain boundary, is rejected in favour of splitting the segment, and
+    // the triangle retried if it survives. Triangles that cannot be fixed
+    // on the lattice are dropped.
+    bool inside[3] = {};
+    HeIx blocked = NoIx;
+    HeIx he = visibilityWalk(T, inside, center, c.he,
+                             [&](HeIx e) { return twin(T, e) == NoIx || isConstrained(T, e); }, blocked);
+    if (he != NoIx) {
+      blocked = encroachedSegment(ctx, he, center);
+      if (blocked == NoIx) {
+        insertSteiner(ctx, center, he);
+        continue;
+      }
+    }
+
+    if (splitNear(ctx, blocked)) {
+      ctx.triangles.push(c);
+    }
+  }
+}
+
+void markOutsideDomain(const Triangulation& T, std::vector<uint8_t>& outside)
+{
+  outside.assign(T.heCount, 0);
+
+  std::vector<HeIx> todo;
+  for (HeIx he = 0; he < T.heCount; he++) {
+    if (triangleKey(T, he) != he || !touchesBoundingCorner(T, he)) continue;
+
+    HeIx he1 = next(T, he);
+    outside[he] = outside[he1] = outside[next(T, he1)] = 1;
+    todo.push_back(he);
+  }
+
+  while (!todo.empty()) {
+    HeIx t = todo.back();
+    todo.pop_back();
+
+    for (size_t k = 0; k < 3; k++, t = next(T, t)) {
+      HeIx tw = twin(T, t);
+      if (tw == NoIx || isConstrained(T, t) || outside[tw]) continue;
+
+      HeIx tw1 = next(T, tw);
+      outside[tw] = outside[tw1] = outside[next(T, tw1)] = 1;
+      todo.push_back(tw);
+    }
+  }
 }
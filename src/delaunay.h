@@ -1,9 +1,15 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 static constexpr uint32_t NoIx = 0xFFFFFFFFu;
 
+static constexpr uint32_t ChunkShift = 12;
+static constexpr uint32_t ChunkSize = 1u << ChunkShift;
+
 
 typedef uint32_t VtxIx;
 typedef uint32_t HeIx;
@@ -26,6 +32,40 @@ struct HalfEdge
   HeIx twin;
 };
 
+struct Triangle
+{
+  VtxIx vtx[3];   // Counter-clockwise, smallest index first
+};
+
+struct Edge
+{
+  VtxIx vtx[2];   // Smallest index first
+};
+
+struct TriangulationDelta
+{
+  std::vector<Triangle> destroyedTriangles;
+  std::vector<Triangle> createdTriangles;
+  std::vector<Edge> destroyedEdges;
+  std::vector<Edge> createdEdges;
+};
+
+// Immutable copy of a triangulation for readers. Storage is split into chunks
+// of ChunkSize entries, and chunks unchanged between consecutive snapshots
+// are shared.
+struct TriangulationSnapshot
+{
+  std::vector<std::shared_ptr<const Vertex[]>> vtxChunks;
+  std::vector<std::shared_ptr<const HalfEdge[]>> heChunks;
+
+  uint32_t vtxCount = 0;
+  uint32_t heCount = 0;
+  uint64_t version = 0;
+
+  const Vertex& vtx(VtxIx ix) const { return vtxChunks[ix >> ChunkShift][ix & (ChunkSize - 1)]; }
+  const HalfEdge& he(HeIx ix) const { return heChunks[ix >> ChunkShift][ix & (ChunkSize - 1)]; }
+};
+
 struct Triangulation
 {
   Triangulation();
@@ -42,8 +82,150 @@ struct Triangulation
 
   uint32_t heCount = 0;
   uint32_t heAlloc = 0;
+
+  // One bit per half-edge, set on both halves of a constrained edge, which
+  // is never flipped. Empty until the first constraint is inserted.
+  std::vector<uint64_t> constrained;
+
+  // When set, every topology change is recorded until drained. The mesh
+  // present when journaling is switched on is not recorded.
+  bool journaling = false;
+  TriangulationDelta journal;
+
+  // Chunks written since the last published snapshot, and that snapshot.
+  // The lock only guards swapping and copying the snapshot pointer.
+  std::vector<uint8_t> vtxDirty;
+  std::vector<uint8_t> heDirty;
+  mutable std::mutex snapshotLock;
+  std::shared_ptr<const TriangulationSnapshot> snapshot;
 };
 
 
 
 VtxIx insertVertex(Triangulation& triang, const Pos& pos);
+
+// Makes the segment between two existing vertices a constrained edge that is
+// never flipped, splitting it at vertices lying exactly on it. Returns false
+// without modifying the triangulation if it crosses an existing constraint.
+bool insertConstraint(Triangulation& triang, VtxIx a, VtxIx b);
+
+// Moves the changes recorded since the last drain into delta, with triangles
+// and edges that were both created and destroyed in between cancelled out.
+void drainJournal(Triangulation& triang, TriangulationDelta& delta);
+
+// Makes the current state visible to acquireSnapshot, copying only the chunks
+// written since the previous publish. Called by the writer between updates.
+void publishSnapshot(Triangulation& triang);
+
+// Latest published snapshot, or null if none. Safe to call from any thread
+// concurrently with the writer, the snapshot stays valid while held. Takes a
+// short internal lock around copying the pointer, so it is not lock-free.
+std::shared_ptr<const TriangulationSnapshot> acquireSnapshot(const Triangulation& triang);
+
+// Half-edge of the snapshot triangle containing pos.
+HeIx findTriangle(const TriangulationSnapshot& snapshot, const Pos& pos, HeIx startingPoint = 0);
+
+
+struct Grid
+{
+  Pos origin;         // Position of sample (0,0)
+  uint32_t stepX;     // Distance between samples along x
+  uint32_t stepY;     // Distance between samples along y
+  uint32_t width;
+  uint32_t height;
+};
+
+enum struct Interpolation
+{
+  Linear,             // Barycentric over the containing triangle
+  NaturalNeighbour    // Sibson's natural-neighbour coordinates
+};
+
+// Interpolates per-vertex values (indexed by VtxIx, vtxCount entries including
+// the four bounding corners) onto grid, writing width*height values row by row
+// into out. A threadCount of zero uses all hardware threads.
+void interpolateGrid(const Triangulation& triang, float* out, const Grid& grid, const float* values,
+                     Interpolation method, unsigned threadCount = 0);
+
+// Builds a simplified terrain into a fresh triangulation by greedy insertion:
+// the grid sample with the largest vertical error is inserted until all
+// samples are within maxError or maxVertices is reached. Heights holds
+// width*height samples row by row. The height of every vertex, with the four
+// bounding corners taking the nearest grid corner, is written to vtxHeights.
+void refineHeightmap(Triangulation& triang, std::vector<float>& vtxHeights, const Grid& grid, const float* heights,
+                     float maxError, uint32_t maxVertices);
+
+struct ClusterMerge
+{
+  uint32_t a;         // Merged clusters, vertex indices for single vertices
+  uint32_t b;         // and vtxCount + i for the cluster formed by merge i
+  double length;      // Length of the spanning-tree edge joining them
+  uint32_t size;      // Number of vertices in the merged cluster
+};
+
+// Euclidean minimum spanning tree of all vertices except the four bounding
+// corners, taken from the Delaunay edges and ranked by exact squared length.
+// Edges are ordered by increasing length, and dendrogram[i] is the
+// single-linkage merge performed by mst[i]. Constrained triangulations may
+// lack Delaunay edges the tree needs.
+void spanningTree(const Triangulation& triang, std::vector<Edge>& mst, std::vector<ClusterMerge>& dendrogram);
+
+struct AlphaEdge
+{
+  VtxIx vtx[2];   // Oriented with the alpha shape on the left once regular
+  double lo;      // On the boundary for lo <= alpha < hi
+  double regular; // Singular, without a triangle of the shape, for alpha < regular
+  double hi;
+};
+
+// Precomputed alpha complex, alpha being a radius, with the critical alpha of
+// every simplex compared exactly. Triangles enter at their circumradius. An
+// edge enters at half its length if no apex of its triangles lies inside its
+// diametral circle, and with its first triangle otherwise. A vertex is
+// isolated until its first edge enters. Each is ordered by its critical
+// alpha, so the alpha shape is a prefix of triangles, of edges ordered by lo
+// and of connected vertices. Triangles touching the four bounding corners and
+// edges to the corners are left out.
+struct AlphaComplex
+{
+  std::vector<HeIx> triangles;        // One half-edge per triangle
+  std::vector<double> triangleAlpha;  // Circumradius of each triangle, non-decreasing
+  std::vector<AlphaEdge> edges;       // Regular and singular boundary edges, by increasing lo
+  std::vector<VtxIx> vertices;        // All but the bounding corners
+  std::vector<double> vertexAlpha;    // Where each gets its first edge, non-decreasing
+};
+
+void buildAlphaComplex(const Triangulation& triang, AlphaComplex& complex);
+
+// Number of leading entries of complex.triangles inside the alpha shape.
+size_t alphaShapeTriangles(const AlphaComplex& complex, double alpha);
+
+// Number of leading entries of complex.vertices with an edge in the alpha
+// shape. The remaining vertices are isolated points of the shape.
+size_t alphaShapeConnected(const AlphaComplex& complex, double alpha);
+
+// Boundary edges of the alpha shape, i.e. the concave hull for radius alpha,
+// singular edges included. Scans every edge with lo <= alpha, which at large
+// alpha is every edge, so the cost does not follow the output size.
+void alphaShapeBoundary(const AlphaComplex& complex, double alpha, std::vector<AlphaEdge>& boundary);
+
+// Ruppert-style quality refinement. Domain triangles whose smallest angle is
+// below minAngle degrees or whose area exceeds maxArea get their circumcenter
+// inserted, rounded to the lattice, until none are left or maxVertices is
+// reached. Vertices are inserted and legalized one at a time, not in batches.
+// Constrained edges are split near their midpoint when encroached upon or
+// when a circumcenter lies behind them. The domain is what markOutsideDomain
+// leaves over. While no constrained edges enclose the four bounding corners,
+// as on a first call, it is the triangles not touching them, and its
+// boundary edges are constrained first. A boundary edge without a lattice
+// point near its midpoint is bent outwards instead, leaving thin triangles
+// outside the domain that touch no corner, so calling again on the result
+// keeps the same domain. Angles above about 30 degrees, and features near
+// the lattice spacing, may only stop at maxVertices.
+void refineQuality(Triangulation& triang, double minAngle, double maxArea, uint32_t maxVertices);
+
+// Sets outside, per half-edge over heCount entries, for triangles reachable
+// from one touching the four bounding corners without crossing a constrained
+// edge. After refineQuality these are exactly the triangles outside its
+// domain.
+void markOutsideDomain(const Triangulation& triang, std::vector<uint8_t>& outside);